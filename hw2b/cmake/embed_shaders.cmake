@@ -0,0 +1,49 @@
+# Turns GLSL files into constexpr strings in a C++ header, so the program
+# starts without reading shader files. Run as a build step:
+#   cmake -DOUTPUT=embedded_shaders.hpp -DSOURCE_DIR=src -DSHADERS=a.vert,b.frag -P embed_shaders.cmake
+# SHADERS are file names relative to SOURCE_DIR, separated by commas, and
+# are looked up by them.
+
+if (NOT OUTPUT OR NOT SOURCE_DIR OR NOT SHADERS)
+    message(FATAL_ERROR "embed_shaders.cmake needs OUTPUT, SOURCE_DIR and SHADERS")
+endif()
+string(REPLACE "," ";" SHADERS "${SHADERS}")
+get_filename_component(SOURCE_DIR_NAME "${SOURCE_DIR}" NAME)
+
+set(HEADER "// Generated by embed_shaders.cmake from the shaders in ${SOURCE_DIR_NAME}/, do not edit\n\n")
+string(APPEND HEADER "#ifndef EMBEDDED_SHADERS_HPP\n#define EMBEDDED_SHADERS_HPP\n\n#include <cstddef>\n\n")
+string(APPEND HEADER "struct EmbeddedShader {\n    const char *name; // file name, relative to the source directory\n")
+string(APPEND HEADER "    const char *source;\n    size_t length;\n};\n\nnamespace embedded_shaders {\n")
+
+set(TABLE "")
+set(COUNT 0)
+foreach (SHADER ${SHADERS})
+    file(READ "${SOURCE_DIR}/${SHADER}" TEXT)
+
+    # One string literal per line, which also keeps clear of compiler limits on a single literal
+    string(REPLACE "\r" "" TEXT "${TEXT}")
+    string(REPLACE "\\" "\\\\" TEXT "${TEXT}")
+    string(REPLACE "\"" "\\\"" TEXT "${TEXT}")
+    string(REPLACE "\n" "\\n\"\n    \"" TEXT "${TEXT}")
+    string(MAKE_C_IDENTIFIER "${SHADER}" NAME)
+
+    string(APPEND HEADER "\nconstexpr char ${NAME}[] =\n    \"${TEXT}\";\n")
+    string(APPEND TABLE "    {\"${SHADER}\", embedded_shaders::${NAME}, sizeof(embedded_shaders::${NAME}) - 1},\n")
+    math(EXPR COUNT "${COUNT} + 1")
+endforeach()
+
+string(APPEND HEADER "\n} // end namespace embedded_shaders\n\n")
+string(APPEND HEADER "constexpr EmbeddedShader EMBEDDED_SHADERS[] = {\n${TABLE}};\n\n")
+string(APPEND HEADER "constexpr size_t NUM_EMBEDDED_SHADERS = ${COUNT};\n\n")
+string(APPEND HEADER "constexpr bool embeddedNameEquals(const char *a, const char *b) {\n")
+string(APPEND HEADER "    return *a == *b && (*a == '\\0' || embeddedNameEquals(a + 1, b + 1));\n}\n\n")
+string(APPEND HEADER "// The shader embedded from file name, nullptr if there is none. Works at compile time too.\n")
+string(APPEND HEADER "constexpr const EmbeddedShader *findEmbeddedShader(const char *name, size_t i = 0) {\n")
+string(APPEND HEADER "    return i == NUM_EMBEDDED_SHADERS ? nullptr :\n")
+string(APPEND HEADER "           embeddedNameEquals(EMBEDDED_SHADERS[i].name, name) ? &EMBEDDED_SHADERS[i] : findEmbeddedShader(name, i + 1);\n}\n\n")
+string(APPEND HEADER "// Whether file name is embedded, for static_assert\n")
+string(APPEND HEADER "constexpr bool hasEmbeddedShader(const char *name, size_t i = 0) {\n")
+string(APPEND HEADER "    return i < NUM_EMBEDDED_SHADERS && (embeddedNameEquals(EMBEDDED_SHADERS[i].name, name) || hasEmbeddedShader(name, i + 1));\n}\n\n")
+string(APPEND HEADER "#endif\n")
+
+file(WRITE "${OUTPUT}" "${HEADER}")
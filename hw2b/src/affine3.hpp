@@ -0,0 +1,160 @@
+#ifndef AFFINE3_HPP
+#define AFFINE3_HPP
+
+#include <cmath>
+#include "mat4.hpp"
+#include "vec3.hpp"
+
+//
+//	Affine transform stored as the top three rows of a 4x4 matrix, [L | t],
+//	with an implied last row of 0 0 0 1. The model matrix is only ever scaled,
+//	rotated and translated, so it stays affine. Composing two transforms this
+//	way takes 9 multiplies per row instead of 16. Convert to Mat4 only to upload.
+//
+
+class Affine3 {
+    // row major, each row loads as one SSE register
+    alignas(16) float rows[3][4];
+
+public:
+
+    // Identity transform
+    Affine3() {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                rows[i][j] = (i == j);
+            }
+        }
+    }
+
+    static Affine3 translation(const Vec3 &t) {
+        Affine3 a;
+        a.rows[0][3] = t.x;
+        a.rows[1][3] = t.y;
+        a.rows[2][3] = t.z;
+        return a;
+    }
+
+    static Affine3 scale(const float scaleX, const float scaleY, const float scaleZ) {
+        Affine3 a;
+        a.rows[0][0] = scaleX;
+        a.rows[1][1] = scaleY;
+        a.rows[2][2] = scaleZ;
+        return a;
+    }
+
+    // Rotation about the z axis, same as Mat4(angleInDegrees)
+    static Affine3 rotation(const float angleInDegrees) {
+        const float c = cos(angleInDegrees / 180 * M_PI), s = sin(angleInDegrees / 180 * M_PI);
+        Affine3 r;
+        r.rows[0][0] = c;
+        r.rows[0][1] = -s;
+        r.rows[1][0] = s;
+        r.rows[1][1] = c;
+        return r;
+    }
+
+    // Element (i, j) of the 4x4 matrix, i < 3
+    float get(const int &i, const int &j) const {
+        return rows[i][j];
+    }
+
+    void set(const int &i, const int &j, const float &k) {
+        rows[i][j] = k;
+    }
+
+    Vec3 getTranslationVec3() const {
+        return {rows[0][3], rows[1][3], rows[2][3]};
+    }
+
+    // Compose, the result applies b first and then this
+    Affine3 operator*(Affine3 const &b) const {
+        Affine3 result;
+#ifdef MAT4_SSE
+        const __m128 b0 = _mm_load_ps(b.rows[0]), b1 = _mm_load_ps(b.rows[1]), b2 = _mm_load_ps(b.rows[2]);
+        for (int i = 0; i < 3; ++i) {
+            __m128 r = _mm_mul_ps(_mm_set1_ps(rows[i][0]), b0);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(rows[i][1]), b1));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(rows[i][2]), b2));
+            r = _mm_add_ps(r, _mm_setr_ps(0, 0, 0, rows[i][3]));
+            _mm_store_ps(result.rows[i], r);
+        }
+#else
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                result.rows[i][j] = rows[i][0] * b.rows[0][j] + rows[i][1] * b.rows[1][j] + rows[i][2] * b.rows[2][j];
+            }
+            result.rows[i][3] += rows[i][3];
+        }
+#endif
+        return result;
+    }
+
+    Vec3 transformPoint(Vec3 const &p) const {
+        return transformVector(p) + getTranslationVec3();
+    }
+
+    // Transforms a direction, so translation is ignored
+    Vec3 transformVector(Vec3 const &v) const {
+        return Vec3(rows[0][0] * v.x + rows[0][1] * v.y + rows[0][2] * v.z,
+                    rows[1][0] * v.x + rows[1][1] * v.y + rows[1][2] * v.z,
+                    rows[2][0] * v.x + rows[2][1] * v.y + rows[2][2] * v.z);
+    }
+
+    // Closed form inverse through the adjugate of L, which must be invertible
+    Affine3 inverse() const {
+        const float (&a)[3][4] = rows;
+        Affine3 result;
+        float (&r)[3][4] = result.rows;
+        r[0][0] = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+        r[0][1] = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+        r[0][2] = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+        r[1][0] = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+        r[1][1] = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+        r[1][2] = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+        r[2][0] = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+        r[2][1] = a[0][1] * a[2][0] - a[0][0] * a[2][1];
+        r[2][2] = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+        const float inverseDeterminant = 1 / (a[0][0] * r[0][0] + a[0][1] * r[1][0] + a[0][2] * r[2][0]);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                r[i][j] *= inverseDeterminant;
+            }
+            r[i][3] = -(r[i][0] * a[0][3] + r[i][1] * a[1][3] + r[i][2] * a[2][3]);
+        }
+        return result;
+    }
+
+    // Applies rotation about pivot after this. Same as
+    // translation(pivot) * rotation * translation(pivot * -1) * *this
+    // but with the three matrices folded into one.
+    Affine3 rotatedAbout(Affine3 const &rotation, Vec3 const &pivot) const {
+        Affine3 aboutPivot = rotation;
+        const Vec3 t = pivot + rotation.getTranslationVec3() - rotation.transformVector(pivot);
+        aboutPivot.rows[0][3] = t.x;
+        aboutPivot.rows[1][3] = t.y;
+        aboutPivot.rows[2][3] = t.z;
+        return aboutPivot * *this;
+    }
+
+    Mat4 toMat4() const {
+        Mat4 m;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                m.set(i, j, rows[i][j]);
+            }
+        }
+        return m;
+    }
+
+    void dumpColumnWise(float *array) const {
+        for (int j = 0; j < 4; ++j) {
+            for (int i = 0; i < 3; ++i) {
+                array[j * 4 + i] = rows[i][j];
+            }
+            array[j * 4 + 3] = j == 3;
+        }
+    }
+};
+
+#endif
@@ -1,11 +1,18 @@
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <vector>
 #include "shader_compiler.hpp"
+#include "embedded_shaders.hpp"
+#include "input_log.hpp"
 #include "mat4.hpp"
+#include "affine3.hpp"
 #include "vec3.hpp"
 
 #ifndef M_PI
@@ -25,7 +32,7 @@ typedef struct {
 const int nvertices = 4;
 
 // General transformation matrix initialized to identity matrix
-Mat4 M(IDENTITY);
+Affine3 M;
 // Some assorted global variables, defined as such to make life easier
 GLint mLocation;
 GLdouble mouseX, mouseY;
@@ -34,51 +41,69 @@ GLboolean doTranslate = GL_FALSE;
 GLint windowWidth = 600;
 GLint windowHeight = 600;
 const float SMALL_ANGLE = 2.0;
-const Mat4 RCCW = Mat4(SMALL_ANGLE);
-const Mat4 RCW = Mat4(-SMALL_ANGLE);
+const Affine3 RCCW = Affine3::rotation(SMALL_ANGLE);
+const Affine3 RCW = Affine3::rotation(-SMALL_ANGLE);
+// Directory to read the shaders from, set by --shader-dir. Without it the
+// copies compiled into the binary are used and no shader file is read.
+const char *shaderDirectory = nullptr;
+// Input written to a log with --record, or fed back from one with --replay,
+// a fixed timestep of simulated time per frame
+InputRecorder recorder;
+InputReplay replay;
+GLboolean replaying = GL_FALSE;
+double timestep = 1.0 / 60;
+
+constexpr const EmbeddedShader *vertexShaderSource = findEmbeddedShader("vertex_shader.glsl");
+constexpr const EmbeddedShader *fragmentShaderSource = findEmbeddedShader("fragment_shader.glsl");
+static_assert(hasEmbeddedShader("vertex_shader.glsl") && hasEmbeddedShader("fragment_shader.glsl"),
+              "the shaders have to be embedded, see SHADERS in CMakeLists.txt");
 
 static void errorCallback(int error, const char *description) {
     cerr << "Error code: " << error << ": " << description << endl;
 }
 
-static void keyCallback(GLFWwindow *window, GLint key, GLint scancode, GLint action, GLint mods) {
+// What a key does, from the window or a replay
+static void applyKey(GLFWwindow *window, GLint key, GLint scancode, GLint action, GLint mods) {
     switch (key) {
         case GLFW_KEY_ESCAPE:
         case GLFW_KEY_Q:
             glfwSetWindowShouldClose(window, GL_TRUE);
             break;
         case GLFW_KEY_R:
-            M = Mat4(IDENTITY);
+            M = Affine3();
             break;
         case GLFW_KEY_RIGHT:
-            M = M * Mat4(1.02f, 1.0f, 0);
+            M = M * Affine3::scale(1.02f, 1.0f, 0);
             break;
         case GLFW_KEY_LEFT:
-            M = M * Mat4(0.98f, 1.0f, 0);
+            M = M * Affine3::scale(0.98f, 1.0f, 0);
             break;
         case GLFW_KEY_UP:
-            M = M * Mat4(1.0f, 1.02f, 0);
+            M = M * Affine3::scale(1.0f, 1.02f, 0);
             break;
         case GLFW_KEY_DOWN:
-            M = M * Mat4(1.0f, 0.98f, 0);
+            M = M * Affine3::scale(1.0f, 0.98f, 0);
             break;
         default:
             break;
     }
 }
 
-static void mouseButtonCallback(GLFWwindow *window, GLint button, GLint action, GLint mods) {
+// What a mouse button does with the cursor at (x, y), from the window or a replay
+static void applyMouseButton(GLFWwindow *window, GLint button, GLint action, GLint mods, GLdouble x, GLdouble y) {
     // Check which mouse button triggered the event, e.g. GLFW_MOUSE_BUTTON_LEFT, etc.
     // and what the button action was, e.g. GLFW_PRESS, GLFW_RELEASE, etc.
     // (Note that ordinary trackpad click = mouse left button)
     // Also check if any modifier keys were active at the time of the button press, e.g. GLFW_MOD_ALT, etc.
     // Take the appropriate action, which could (optionally) also include changing the cursor's appearance
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && mods != GLFW_MOD_CONTROL) {
-        glfwGetCursorPos(window, &mouseX, &mouseY);
+        mouseX = x;
+        mouseY = y;
         glfwSetCursor(window, glfwCreateStandardCursor(GLFW_HRESIZE_CURSOR));
         doRotate = GL_TRUE;
     } else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && mods == GLFW_MOD_CONTROL) {
-        glfwGetCursorPos(window, &mouseX, &mouseY);
+        mouseX = x;
+        mouseY = y;
         glfwSetCursor(window, glfwCreateStandardCursor(GLFW_HAND_CURSOR));
         doTranslate = GL_TRUE;
     } else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
@@ -88,7 +113,8 @@ static void mouseButtonCallback(GLFWwindow *window, GLint button, GLint action,
     }
 }
 
-static void cursorPositionCallback(GLFWwindow *window, GLdouble x, GLdouble y) {
+// What moving the cursor to (x, y) does, from the window or a replay
+static void applyCursorPosition(GLdouble x, GLdouble y) {
     // determine the direction of the mouse or cursor motion
     // update the current mouse or cursor location
     //  (necessary to quantify the amount and direction of cursor motion)
@@ -97,17 +123,17 @@ static void cursorPositionCallback(GLFWwindow *window, GLdouble x, GLdouble y) {
     if (doRotate) {
         if (x - mouseX > 0) {
             // moved right => rotate clockwise
-            M = Mat4(translation) * RCW * Mat4(translation * -1) * M;
+            M = M.rotatedAbout(RCW, translation);
         } else if (x - mouseX < 0) {
             // moved left => rotate counter-clockwise
-            M = Mat4(translation) * RCCW * Mat4(translation * -1) * M;
+            M = M.rotatedAbout(RCCW, translation);
         }
         mouseX = x;
     }
     if (doTranslate) {
         GLdouble dx = x - mouseX;
         GLdouble dy = mouseY - y;
-        M = Mat4(Vec3(dx * 2 / windowWidth, dy * 2 / windowHeight, 0)) * M;
+        M = Affine3::translation(Vec3(dx * 2 / windowWidth, dy * 2 / windowHeight, 0)) * M;
         if (M.get(0, 3) < -1) {
             M.set(0, 3, -1);
         } else if (M.get(0, 3) > 1) {
@@ -123,6 +149,48 @@ static void cursorPositionCallback(GLFWwindow *window, GLdouble x, GLdouble y) {
     }
 }
 
+// The callbacks record what they get, and while a log is replayed the person
+// at the keyboard can only quit
+static void keyCallback(GLFWwindow *window, GLint key, GLint scancode, GLint action, GLint mods) {
+    if (replaying && key != GLFW_KEY_ESCAPE && key != GLFW_KEY_Q) { return; }
+    recorder.key(glfwGetTime(), key, scancode, action, mods);
+    applyKey(window, key, scancode, action, mods);
+}
+
+static void mouseButtonCallback(GLFWwindow *window, GLint button, GLint action, GLint mods) {
+    if (replaying) { return; }
+    GLdouble x, y;
+    glfwGetCursorPos(window, &x, &y);
+    recorder.mouseButton(glfwGetTime(), button, action, mods, x, y);
+    applyMouseButton(window, button, action, mods, x, y);
+}
+
+static void cursorPositionCallback(GLFWwindow *window, GLdouble x, GLdouble y) {
+    if (replaying) { return; }
+    recorder.cursor(glfwGetTime(), x, y);
+    applyCursorPosition(x, y);
+}
+
+// Does what a replayed event did when it was recorded
+static void applyInputEvent(GLFWwindow *window, const InputEvent &e) {
+    if (e.type == INPUT_KEY) { applyKey(window, e.key, e.scancode, e.action, e.mods); }
+    else if (e.type == INPUT_MOUSE_BUTTON) { applyMouseButton(window, e.button, e.action, e.mods, e.x, e.y); }
+    else if (e.type == INPUT_CURSOR) { applyCursorPosition(e.x, e.y); }
+}
+
+// Prints the mean, median, 95th and 99th percentile and extremes of the frame times seconds
+static void printFrameTimes(vector<double> seconds) {
+    if (seconds.empty()) { return; }
+    sort(seconds.begin(), seconds.end());
+    double total = 0;
+    for (double s : seconds) { total += s; }
+    const double mean = total / seconds.size();
+    auto percentile = [&](double p) { return seconds[min(seconds.size() - 1, (size_t) (p * seconds.size()))] * 1000; };
+    cout << seconds.size() << " frames: " << mean * 1000 << " ms mean (" << 1 / mean << " fps), p50 " << percentile(0.5)
+         << ", p95 " << percentile(0.95) << ", p99 " << percentile(0.99) << ", min " << seconds.front() * 1000
+         << ", max " << seconds.back() * 1000 << " ms" << endl;
+}
+
 void initStaticDataAndShaders() {
     ColorType3D colors[4];
     // Hard code the geometry of interest
@@ -162,12 +230,19 @@ void initStaticDataAndShaders() {
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices) + sizeof(colors), vertices, GL_STATIC_DRAW);
     glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
     glBufferSubData(GL_ARRAY_BUFFER, sizeof(vertices), sizeof(colors), colors);
-    // Define the names of the shader files
-    stringstream vshader, fshader;
-    vshader << SRC_DIR << "/vertex_shader.glsl";
-    fshader << SRC_DIR << "/fragment_shader.glsl";
-    // Load the shaders and use the resulting shader program
-    GLuint program = compileShader(vshader.str().c_str(), fshader.str().c_str());
+    // Load the shaders and use the resulting shader program, cached as a binary after the first launch
+    double shaderStart = glfwGetTime();
+    GLuint program;
+    if (shaderDirectory != nullptr) {
+        // Define the names of the shader files
+        stringstream vshader, fshader;
+        vshader << shaderDirectory << "/vertex_shader.glsl";
+        fshader << shaderDirectory << "/fragment_shader.glsl";
+        program = compileShader(vshader.str().c_str(), fshader.str().c_str(), CACHE_DIR);
+    } else {
+        program = compileShaderSources(vertexShaderSource->source, fragmentShaderSource->source, CACHE_DIR);
+    }
+    cout << "Shader program ready in " << (glfwGetTime() - shaderStart) * 1000 << " ms" << endl;
     // Determine locations of the necessary attributes and matrices used in the vertex shader
     GLuint vertexPositionLocation = glGetAttribLocation(program, "vertexPosition");
     glEnableVertexAttribArray(vertexPositionLocation);
@@ -181,6 +256,25 @@ void initStaticDataAndShaders() {
 }
 
 int main(int argc, char **argv) {
+    // Command line: [--shader-dir dir] [--record file] [--replay file] [--timestep s]
+    const char *recordFile = nullptr;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--shader-dir") == 0) { shaderDirectory = argv[++i]; }
+        else if (strcmp(argv[i], "--record") == 0) { recordFile = argv[++i]; }
+        else if (strcmp(argv[i], "--timestep") == 0) { timestep = max(1e-4, atof(argv[++i])); }
+        else if (strcmp(argv[i], "--replay") == 0) {
+            if (!replay.load(argv[++i])) {
+                cerr << "Could not replay input: " << replay.error << endl;
+                exit(EXIT_FAILURE);
+            }
+            replaying = GL_TRUE;
+        }
+    }
+    if (recordFile != nullptr && replaying) {
+        cerr << "--record is ignored with --replay" << endl;
+        recordFile = nullptr;
+    }
+
     // -------- -------- GLFW setup -------- --------
     GLFWwindow *window;
     // Define the error callback function
@@ -202,8 +296,9 @@ int main(int argc, char **argv) {
     }
     // Makes the newly-created context current
     glfwMakeContextCurrent(window);
-    // Tells the system to wait to swap buffers until monitor refresh has completed; necessary to avoid tearing
-    glfwSwapInterval(1);
+    // Tells the system to wait to swap buffers until monitor refresh has completed; necessary to avoid tearing.
+    // A replay runs as fast as it can instead, its frame times are what it measures.
+    glfwSwapInterval(replaying ? 0 : 1);
     // Define the keyboard callback function
     glfwSetKeyCallback(window, keyCallback);
     // Define the mouse button callback function
@@ -222,24 +317,51 @@ int main(int argc, char **argv) {
     // -------- -------- Init data and compile shaders -------- --------
     initStaticDataAndShaders();
 
+    // -------- -------- Record or replay input -------- --------
+    if (recordFile != nullptr && !recorder.open(recordFile, glfwGetTime())) {
+        cerr << "Could not write input log " << recordFile << endl;
+    }
+    if (replaying) {
+        cout << "Replaying " << replay.events.size() << " input events, " << replay.duration() << " s at a "
+             << timestep * 1000 << " ms timestep" << endl;
+    }
+    int replayFrames = 0;
+    double lastSwap = 0;
+    vector<double> replaySeconds;
+
     // -------- -------- Graphics rendering loop -------- --------
     while (!glfwWindowShouldClose(window)) {
+        // A replay feeds in the events recorded up to this frame's time, which advances a fixed step per frame
+        if (replaying) { replay.feed(replayFrames++ * timestep, [window](const InputEvent &e) { applyInputEvent(window, e); }); }
         // Fill the window with the background color
         glClear(GL_COLOR_BUFFER_BIT);
         // Sanity check that your matrix contents are what you expect them to be
         // printMat4(M);
         // Send the model transformation matrix to the GPU
-        float values[16];
-        M.dumpColumnWise(values);
-        glUniformMatrix4fv(mLocation, 1, GL_FALSE, values);
+        glUniformMatrix4fv(mLocation, 1, GL_FALSE, M.toMat4().data());
         // Draw a triangle between the first vertex and each successive vertex pair
         glDrawArrays(GL_TRIANGLE_FAN, 0, nvertices);
         // Ensure that all OpenGL calls have executed before swapping buffers
         glFlush();
         // Swap buffers
         glfwSwapBuffers(window);
-        // Wait for an event, then handle it
-        glfwWaitEvents();
+        if (replaying) {
+            // Time the replay from swap to swap, and stop it after its last event
+            const double swap = chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+            if (lastSwap > 0) { replaySeconds.push_back(swap - lastSwap); }
+            lastSwap = swap;
+            if (replay.finished()) { glfwSetWindowShouldClose(window, GL_TRUE); }
+            glfwPollEvents();
+        } else {
+            // Wait for an event, then handle it
+            glfwWaitEvents();
+        }
+    }
+    if (replaying) { printFrameTimes(replaySeconds); }
+    if (recorder.recording()) {
+        const size_t events = recorder.size();
+        if (recorder.close()) { cout << "Recorded " << events << " input events to " << recordFile << endl; }
+        else { cerr << "Could not write input log " << recordFile << endl; }
     }
 
     // -------- -------- GLFW cleanup -------- --------
@@ -3,12 +3,17 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <sstream>
-#include <vector>
 #include <algorithm>
 #include <utility>
 #include "vec3.hpp"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MAT4_SSE
+#include <xmmintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
 #endif
@@ -17,17 +22,29 @@ enum INIT {
     IDENTITY, ONES, ZEROS
 };
 
+//
+//	4x4 float matrix stored inline, 16 byte aligned and column-major, which is
+//	what glUniformMatrix4fv takes. Nothing allocates, so temporaries are free
+//	to make and copy. Multiply, transpose and transformVector use SSE and add
+//	the products in the same order as the scalar loops, so results don't change.
+//
+
 class Mat4 {
-    // row major order
-    std::vector<float> values;
-    const int nR, nC;
+    // column major order, element (i, j) is values[j * 4 + i]
+    alignas(16) float values[16];
 
     friend std::ostream &operator<<(std::ostream &, const Mat4 &);
 
+    float &at(int i, int j) { return values[j * 4 + i]; }
+
+    // Leaves the values unset, for results that are about to be overwritten
+    struct Uninitialized {};
+
+    explicit Mat4(Uninitialized) {}
+
 public:
 
-    explicit Mat4(enum INIT init = IDENTITY) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(enum INIT init = IDENTITY) {
         switch (init) {
             case IDENTITY:
                 setIdentity();
@@ -44,192 +61,183 @@ public:
         }
     }
 
-    explicit Mat4(const float angleInDegrees) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(const float angleInDegrees) {
         setIdentity();
-        values[0] = cos(angleInDegrees / 180 * M_PI);
-        values[1] = -sin(angleInDegrees / 180 * M_PI);
-        values[4] = sin(angleInDegrees / 180 * M_PI);
-        values[5] = cos(angleInDegrees / 180 * M_PI);
+        at(0, 0) = cos(angleInDegrees / 180 * M_PI);
+        at(0, 1) = -sin(angleInDegrees / 180 * M_PI);
+        at(1, 0) = sin(angleInDegrees / 180 * M_PI);
+        at(1, 1) = cos(angleInDegrees / 180 * M_PI);
     }
 
-    explicit Mat4(const Vec3 translation) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(const Vec3 translation) {
         setIdentity();
-        values[3] = translation.x;
-        values[7] = translation.y;
-        values[11] = translation.z;
+        at(0, 3) = translation.x;
+        at(1, 3) = translation.y;
+        at(2, 3) = translation.z;
     }
 
-    explicit Mat4(const float scaleX, const float scaleY, const float scaleZ) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(const float scaleX, const float scaleY, const float scaleZ) {
         setIdentity();
-        values[0] = scaleX;
-        values[5] = scaleY;
-        values[10] = scaleZ;
+        at(0, 0) = scaleX;
+        at(1, 1) = scaleY;
+        at(2, 2) = scaleZ;
     }
 
-    Mat4(const Mat4 &m) : nR(m.nR), nC(m.nC) {
-        values.resize(nR * nC);
-        // deep copy the values variable
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = m.values[i * nC + j];
-            }
-        }
-    }
-
-    void operator=(Mat4 const &m) {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = m.values[i * nC + j];
-            }
-        }
+    float get(const int &i, const int &j) const {
+        return values[j * 4 + i];
     }
 
-    ~Mat4() = default;
-
-    float get(const int &i, const int &j) const {
-        return values[i * nC + j];
+    // Column major values, ready for glUniformMatrix4fv
+    const float *data() const {
+        return values;
     }
 
     void set(const int &i, const int &j, const float &k) {
-        values[i * nC + j] = k;
+        values[j * 4 + i] = k;
     }
 
     Mat4 *setZeros() {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = 0;
-            }
-        }
+        std::fill(values, values + 16, 0.f);
         return this;
     }
 
     Mat4 *setOnes() {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = 1;
-            }
-        }
+        std::fill(values, values + 16, 1.f);
         return this;
     }
 
     Mat4 *setIdentity() {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = (i == j);
-            }
+        for (int k = 0; k < 16; ++k) {
+            values[k] = (k % 5 == 0);
         }
         return this;
     }
 
     Mat4 *setUniform(float low, float high) {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
                 float randomNumber = (float) rand() / RAND_MAX;
                 randomNumber = low + randomNumber * (high - low);
-                values[i * nC + j] = randomNumber;
+                at(i, j) = randomNumber;
             }
         }
         return this;
     }
 
+    // Transpose
     Mat4 operator~() const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[j * nR + i] = this->values[i * nC + j];
+        Mat4 result{Uninitialized()};
+#ifdef MAT4_SSE
+        __m128 c0 = _mm_load_ps(values), c1 = _mm_load_ps(values + 4);
+        __m128 c2 = _mm_load_ps(values + 8), c3 = _mm_load_ps(values + 12);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        _mm_store_ps(result.values, c0);
+        _mm_store_ps(result.values + 4, c1);
+        _mm_store_ps(result.values + 8, c2);
+        _mm_store_ps(result.values + 12, c3);
+#else
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                result.at(j, i) = get(i, j);
             }
         }
-
+#endif
         return result;
     }
 
+    // Element-wise add
     Mat4 operator+(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] + m.values[i * nC + j];
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] + m.values[k];
         }
-
         return result;
     }
 
+    // Element-wise subtract
     Mat4 operator-(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] - m.values[i * nC + j];
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] - m.values[k];
         }
-
         return result;
     }
 
+    // Matrix multiply, column j of the result is this times column j of m
     Mat4 operator*(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < m.nC; ++j) {
-                float elementSum = 0;
-                for (int k = 0; k < nC; ++k) {
-                    elementSum += this->values[i * nC + k] * m.values[k * m.nC + j];
+        Mat4 result{Uninitialized()};
+#ifdef MAT4_SSE
+        const __m128 a0 = _mm_load_ps(values), a1 = _mm_load_ps(values + 4);
+        const __m128 a2 = _mm_load_ps(values + 8), a3 = _mm_load_ps(values + 12);
+        for (int j = 0; j < 4; ++j) {
+            const float *b = m.values + j * 4;
+            __m128 c = _mm_mul_ps(a0, _mm_set1_ps(b[0]));
+            c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(b[1])));
+            c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(b[2])));
+            c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(b[3])));
+            _mm_store_ps(result.values + j * 4, c);
+        }
+#else
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                float elementSum = get(i, 0) * m.get(0, j);
+                for (int k = 1; k < 4; ++k) {
+                    elementSum += get(i, k) * m.get(k, j);
                 }
-                result.values[i * m.nC + j] = elementSum;
+                result.at(i, j) = elementSum;
             }
         }
+#endif
         return result;
     }
 
-
+    // Element-wise scalar multiply
     Mat4 operator*(float const &value) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] * value;
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] * value;
         }
-
         return result;
     }
 
+    // Transforms a direction, so translation is ignored
+    Vec3 transformVector(Vec3 const &v) const {
+#ifdef MAT4_SSE
+        __m128 r = _mm_mul_ps(_mm_load_ps(values), _mm_set1_ps(v.x));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(values + 4), _mm_set1_ps(v.y)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(values + 8), _mm_set1_ps(v.z)));
+        alignas(16) float result[4];
+        _mm_store_ps(result, r);
+        return Vec3(result[0], result[1], result[2]);
+#else
+        return Vec3(get(0, 0) * v.x + get(0, 1) * v.y + get(0, 2) * v.z,
+                    get(1, 0) * v.x + get(1, 1) * v.y + get(1, 2) * v.z,
+                    get(2, 0) * v.x + get(2, 1) * v.y + get(2, 2) * v.z);
+#endif
+    }
 
+    // Element-wise multiply
     Mat4 operator%(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] * m.values[i * nC + j];
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] * m.values[k];
         }
-
         return result;
     }
 
     void dumpColumnWise(float *array) const {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                array[i + j * nR] = this->values[i * nC + j];
-            }
-        }
+        std::memcpy(array, values, sizeof(values));
     }
 
     Vec3 getTranslationVec3() const {
-        return {values[3], values[7], values[11]};
+        return {get(0, 3), get(1, 3), get(2, 3)};
     }
-
 };
 
 std::ostream &operator<<(std::ostream &out, const Mat4 &m) {
-    for (int i = 0; i < m.nR; ++i) {
-        for (int j = 0; j < m.nC; ++j) {
-            out << m.values[i * m.nC + j] << " ";
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            out << m.get(i, j) << " ";
         }
         out << std::endl;
     }
@@ -1,6 +1,8 @@
 #ifndef SHADER_STUFF
 #define SHADER_STUFF 1
 
+#include "program_cache.hpp"
+
 using namespace std;
 
 #define DEBUG_ON 1
@@ -39,10 +41,13 @@ static char *readFile(const char *shaderFile) {
     return buffer;
 }
 
-// Create a GLSL program object from vertex and fragment shader files
-GLuint compileShader(const char *vShaderFileName, const char *fShaderFileName) {
-    // Check GLSL version
-    cout << "GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+GLuint compileShaderSources(const GLchar *vertexShaderCode, const GLchar *fragmentShaderCode,
+                            const char *cacheDirectory = nullptr);
+
+// Create a GLSL program object from vertex and fragment shader files. With a
+// cacheDirectory, the linked program is kept there as a binary and loaded
+// instead of compiled when the sources and driver are the same.
+GLuint compileShader(const char *vShaderFileName, const char *fShaderFileName, const char *cacheDirectory = nullptr) {
     // Read shader code
     GLchar *vertexShaderCode = readFile(vShaderFileName);
     if (vertexShaderCode == nullptr) {
@@ -60,6 +65,28 @@ GLuint compileShader(const char *vShaderFileName, const char *fShaderFileName) {
         }
         exit(EXIT_FAILURE);
     }
+    GLuint program = compileShaderSources(vertexShaderCode, fragmentShaderCode, cacheDirectory);
+    delete[] vertexShaderCode;
+    delete[] fragmentShaderCode;
+    return program;
+}
+
+// Create a GLSL program object from vertex and fragment shader code, e.g.
+// embedded in the binary. Caches the program like compileShader.
+GLuint compileShaderSources(const GLchar *vertexShaderCode, const GLchar *fragmentShaderCode, const char *cacheDirectory) {
+    // Check GLSL version
+    cout << "GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+    // Load the program from the binary cache if it has one the driver takes
+    const bool useCache = cacheDirectory != nullptr && programBinariesSupported();
+    const uint64_t key = useCache ? programCacheKey(vertexShaderCode, fragmentShaderCode, "") : 0;
+    const string cacheFile = useCache ? programCacheFile(cacheDirectory, key) : "";
+    if (useCache) {
+        if (GLuint program = loadProgramBinary(cacheFile, key)) {
+            cout << "Loaded shader program from " << cacheFile << endl;
+            glUseProgram(program);
+            return program;
+        }
+    }
     // Create shaders
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
     GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -109,9 +136,15 @@ GLuint compileShader(const char *vShaderFileName, const char *fShaderFileName) {
     glAttachShader(program, fragmentShader);
 
     // Link and set program to use
+    if (useCache) { program_cache_detail::gl().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); }
     glLinkProgram(program);
     glUseProgram(program);
 
+    // Save it for the next launch
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (useCache && linked == GL_TRUE) { saveProgramBinary(program, cacheFile, key); }
+
     return program;
 }
 
@@ -0,0 +1,1010 @@
+#include <GLFW/glfw3.h>
+#include "gl.h"
+#include "gl3.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "affine3.hpp"
+#include "bench.hpp"
+#include "frame_uniforms.hpp"
+#include "headless.hpp"
+#include "mat4.hpp"
+#include "shader.hpp"
+#include "shader_variants.hpp"
+#include "transform_batch.hpp"
+#include "trimesh.hpp"
+
+//
+//	Benchmarks, built as HW2c-bench so the app has none of their code, and
+//	none of the allocation counting the Mat4 one replaces operator new for.
+//
+//	HW2c-bench load [file.obj ...]
+//		Times TriMesh::load_obj, serial and parallel, against load_obj_reference
+//		and checks that all of them produce the same mesh. Also times
+//		the deduplicating loader and checks it makes the same triangles. Without files it uses sibenik and a
+//		synthetic multi-million triangle grid.
+//
+//	HW2c-bench normals [file.obj ...]
+//		Times TriMesh::need_normals on one thread and on all of them against
+//		need_normals_reference and checks the normals are bit for bit the same.
+//		Uses the same files as load by default.
+//
+//	HW2c-bench mat4
+//		Times Mat4 multiply, transpose, transformVector, the pivot rotation HW2b
+//		does on every mouse event and uploads, and counts heap allocations in
+//		each. Also checks the SIMD kernels against plain loops. Then times the
+//		same for Affine3 compose, inverse and the folded pivot rotation, and
+//		checks them against Mat4. Mat4::inverse is timed and checked too.
+//
+//	HW2c-bench transform
+//		Transforms arrays of points, AoS and SoA, with every SIMD level this CPU
+//		has and on all cores, and takes their bounding boxes. Prints GB/s read
+//		and written, and checks every kernel gives the same bits as the scalar one.
+//
+//	HW2c-bench shaders
+//		Times setting up the shaders up to their first draw from source, then
+//		with the program binary cache cold (compile and save) and warm (load
+//		the binary). A comment per round keeps the driver's own caches cold.
+//		Also corrupts the saved binary and checks that the shader is compiled
+//		and saved again.
+//
+//	HW2c-bench async-shaders
+//		Starts up with 16 variants of shader.vert and shader.frag the way the
+//		app could: building each before the first frame, building them async
+//		with the driver's parallel compile, and on a ShaderWorker thread.
+//		Until all are ready it draws placeholder frames. Prints the time to the
+//		first frame, the longest frame while waiting and the time until all
+//		variants have drawn. Needs EGL, for the worker's shared context.
+//
+//	HW2c-bench variants
+//		Precompiles all 16 shader variants through ShaderVariants, with no
+//		worker and with 1, 2 and 4 ShaderWorker threads, and prints the time
+//		until every variant has drawn. Then draws a grid over a 512x512
+//		framebuffer 8 times a frame with a few variants, to show what the
+//		features cost in the fragment shader. Needs EGL, for the workers'
+//		shared contexts, as async-shaders does.
+//
+//	HW2c-bench mvp [file.obj ...]
+//		Draws each mesh into a small offscreen framebuffer, so the vertex
+//		shader is the bottleneck, with the old shader that multiplies
+//		projection * view * model for every vertex and with shader.vert that
+//		takes MatrixUniforms. Prints ms per frame drawn as triangles, and for
+//		shading each vertex once with rasterization off. First times the
+//		CPU side of handing a frame's matrices over, uniform by uniform (looked
+//		up by name, id or handle) and through the Frame block ring.
+//		Uses the same files as load by default.
+//
+//	All but load, normals, mat4 and transform render offscreen, in the
+//	HeadlessContext the app's --headless uses, so on llvmpipe when there is
+//	no GPU.
+//
+
+namespace bench {
+
+// Number of operator new calls so far, for the Mat4 benchmark
+static std::atomic<size_t> allocations(0);
+
+} // end namespace bench
+
+void *operator new(size_t size) {
+    bench::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size > 0 ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+// GCC sees free where these are inlined after a new and can't tell it came from malloc
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+namespace bench {
+
+template<class T>
+static bool sameArray(const std::vector<T> &a, const std::vector<T> &b) {
+    return a.size() == b.size() && (a.empty() || std::memcmp(&a[0], &b[0], a.size() * sizeof(T)) == 0);
+}
+
+static bool sameMesh(const TriMesh &a, const TriMesh &b) {
+    return sameArray(a.vertices, b.vertices) && sameArray(a.normals, b.normals) &&
+           sameArray(a.colors, b.colors) && sameArray(a.faces, b.faces);
+}
+
+static bool sameVec(const Vec3f &a, const Vec3f &b) { return std::memcmp(&a, &b, sizeof(Vec3f)) == 0; }
+
+// True if both meshes have the same triangles corner for corner, however they are indexed
+static bool sameCorners(const TriMesh &a, const TriMesh &b) {
+    if (a.faces.size() != b.faces.size() || a.normals.size() != a.vertices.size() ||
+        b.normals.size() != b.vertices.size()) { return false; }
+    for (size_t f = 0; f < a.faces.size(); ++f) {
+        for (int k = 0; k < 3; ++k) {
+            int i = a.faces[f][k], j = b.faces[f][k];
+            if (!sameVec(a.vertices[i], b.vertices[j]) || !sameVec(a.colors[i], b.colors[j]) ||
+                !sameVec(a.normals[i], b.normals[j])) { return false; }
+        }
+    }
+    return true;
+}
+
+// Writes an n x n grid with per vertex colors and normals.
+// Even rows are quads and odd rows triangles, so 2*n*n triangles in total.
+static bool writeGridObj(const std::string &file, int n) {
+    FILE *fp = std::fopen(file.c_str(), "w");
+    if (fp == nullptr) { return false; }
+    for (int i = 0; i <= n; ++i) {
+        for (int j = 0; j <= n; ++j) {
+            float x = (float) j / n, z = (float) i / n;
+            std::fprintf(fp, "v %f %f %f %f %f %f\n", x, 0.1f * std::sin(10 * x) * std::cos(10 * z), z, x, z, 0.5f);
+        }
+    }
+    for (int i = 0; i <= n; ++i) {
+        for (int j = 0; j <= n; ++j) { std::fprintf(fp, "vn 0 1 0\n"); }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            int a = i * (n + 1) + j + 1, b = a + 1, c = a + n + 2, d = a + n + 1;
+            if (i % 2 == 0) { std::fprintf(fp, "f %d//%d %d//%d %d//%d %d//%d\n", a, a, b, b, c, c, d, d); }
+            else {
+                std::fprintf(fp, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c);
+                std::fprintf(fp, "f %d %d %d\n", a, c, d);
+            }
+        }
+    }
+    return std::fclose(fp) == 0;
+}
+
+// Times both loaders and the parallel loader on one file, returns false if their meshes differ
+static bool loadObjFile(const std::string &file) {
+    TriMesh reference, serial, parallel, indexed;
+    double t0 = now();
+    if (!reference.load_obj_reference(file)) { return false; }
+    double t1 = now();
+    if (!serial.load_obj(file, 1)) { return false; }
+    double t2 = now();
+    if (!parallel.load_obj(file, 0)) { return false; }
+    double t3 = now();
+    if (!indexed.load_obj(file, 0, true)) { return false; }
+    double t4 = now();
+
+    bool same = sameMesh(reference, serial) && sameMesh(serial, parallel);
+    bool sameIndexed = indexed.normals.size() < indexed.vertices.size() || sameCorners(serial, indexed);
+    std::cout << "\n" << file << "\n"
+              << "  faces:              " << serial.faces.size() << "\n"
+              << "  load_obj_reference: " << (t1 - t0) * 1000 << " ms\n"
+              << "  load_obj:           " << (t2 - t1) * 1000 << " ms (" << (t1 - t0) / (t2 - t1) << "x)\n"
+              << "  load_obj, " << ThreadPool::global().size() << " threads: "
+              << (t3 - t2) * 1000 << " ms (" << (t1 - t0) / (t3 - t2) << "x)\n"
+              << "  identical:          " << (same ? "yes" : "NO") << "\n"
+              << "  load_obj, indexed:  " << (t4 - t3) * 1000 << " ms, " << serial.vertices.size() << " -> "
+              << indexed.vertices.size() << " vertices, same triangles: " << (sameIndexed ? "yes" : "NO") << std::endl;
+    return same && sameIndexed;
+}
+
+// Files to run a benchmark on, the given ones or sibenik and a grid written
+// to grid, which the caller removes
+static std::vector<std::string> benchFiles(int argc, char *argv[], std::string &grid) {
+    std::vector<std::string> files(argv, argv + argc);
+    if (files.empty()) {
+        std::string sibenik = std::string(MY_DATA_DIR) + "sibenik/sibenik.obj";
+        if (std::filesystem::exists(sibenik)) { files.push_back(sibenik); }
+        else { std::cout << "Skipping " << sibenik << ", not found" << std::endl; }
+
+        grid = (std::filesystem::temp_directory_path() / "hw2c_grid.obj").string();
+        std::cout << "Writing " << grid << std::endl;
+        if (!writeGridObj(grid, 1000)) {
+            std::cerr << "Could not write " << grid << std::endl;
+            std::remove(grid.c_str());
+            grid.clear();
+        } else {
+            files.push_back(grid);
+        }
+    }
+    return files;
+}
+
+static int loadObj(int argc, char *argv[]) {
+    std::string grid;
+    std::vector<std::string> files = benchFiles(argc, argv, grid);
+    if (files.empty()) { return EXIT_FAILURE; }
+
+    bool ok = true;
+    for (const std::string &file : files) { ok = loadObjFile(file) && ok; }
+    if (!grid.empty()) { std::remove(grid.c_str()); }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Times the normal routines on one file, returns false if their normals differ
+static bool normalsFile(const std::string &file) {
+    TriMesh reference;
+    if (!reference.load_obj(file, 0, true)) { return false; }
+    TriMesh serial = reference, parallel = reference;
+
+    double t0 = now();
+    reference.need_normals_reference(true);
+    double t1 = now();
+    serial.need_normals(true, 1);
+    double t2 = now();
+    parallel.need_normals(true, 0);
+    double t3 = now();
+
+    bool same = sameArray(reference.normals, serial.normals) && sameArray(serial.normals, parallel.normals);
+    std::cout << "\n" << file << "\n"
+              << "  faces:                  " << reference.faces.size() << ", vertices: " << reference.vertices.size() << "\n"
+              << "  need_normals_reference: " << (t1 - t0) * 1000 << " ms\n"
+              << "  need_normals:           " << (t2 - t1) * 1000 << " ms (" << (t1 - t0) / (t2 - t1) << "x)\n"
+              << "  need_normals, " << ThreadPool::global().size() << " threads: "
+              << (t3 - t2) * 1000 << " ms (" << (t1 - t0) / (t3 - t2) << "x)\n"
+              << "  identical:              " << (same ? "yes" : "NO") << std::endl;
+    return same;
+}
+
+static int normals(int argc, char *argv[]) {
+    std::string grid;
+    std::vector<std::string> files = benchFiles(argc, argv, grid);
+    if (files.empty()) { return EXIT_FAILURE; }
+
+    bool ok = true;
+    for (const std::string &file : files) { ok = normalsFile(file) && ok; }
+    if (!grid.empty()) { std::remove(grid.c_str()); }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Runs op iterations times, prints the time and heap allocations per call
+template<typename F>
+static void mat4Case(const char *name, int iterations, const F &op) {
+    size_t before = allocations.load();
+    double start = now();
+    for (int i = 0; i < iterations; ++i) { op(); }
+    double seconds = now() - start;
+    size_t allocated = allocations.load() - before;
+    std::printf("  %-28s %8.2f ns, %g allocations per call\n", name, seconds / iterations * 1e9,
+                (double) allocated / iterations);
+}
+
+static bool sameBits(float a, float b) { return std::memcmp(&a, &b, sizeof(float)) == 0; }
+
+// Compares the Mat4 kernels on random matrices with the row major loops they replaced
+static bool mat4MatchesLoops() {
+    for (int trial = 0; trial < 1000; ++trial) {
+        Mat4 a, b;
+        a.setUniform(-1, 1);
+        b.setUniform(-1, 1);
+        Vec3 v(a.get(3, 0), a.get(3, 1), a.get(3, 2));
+        const Mat4 product = a * b, transposed = ~a;
+        const Vec3 transformed = a.transformVector(v);
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                float elementSum = 0;
+                for (int k = 0; k < 4; ++k) { elementSum += a.get(i, k) * b.get(k, j); }
+                if (!sameBits(product.get(i, j), elementSum) || !sameBits(transposed.get(j, i), a.get(i, j))) {
+                    return false;
+                }
+            }
+            if (i < 3 && !sameBits((&transformed.x)[i], a.get(i, 0) * v.x + a.get(i, 1) * v.y + a.get(i, 2) * v.z)) {
+                return false;
+            }
+        }
+        float columns[16];
+        a.dumpColumnWise(columns);
+        if (std::memcmp(columns, a.data(), sizeof(columns)) != 0) { return false; }
+    }
+    return true;
+}
+
+// Largest difference between an affine transform and a matrix
+static float difference(const Affine3 &a, const Mat4 &m) {
+    float d = std::fabs(m.get(3, 0)) + std::fabs(m.get(3, 1)) + std::fabs(m.get(3, 2)) + std::fabs(m.get(3, 3) - 1);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) { d = std::max(d, std::fabs(a.get(i, j) - m.get(i, j))); }
+    }
+    return d;
+}
+
+// Checks Affine3 compose is exactly the Mat4 product, and that the inverses and
+// the folded pivot rotation are the same as with Mat4 up to rounding
+static bool affineMatchesMat4() {
+    for (int trial = 0; trial < 1000; ++trial) {
+        Mat4 random;
+        random.setUniform(-1, 1);
+        Affine3 a, b = Affine3::rotation(trial, (AXIS) (trial % 3));
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) { a.set(i, j, random.get(i, j) + (i == j) * 3); } // well conditioned
+        }
+        const Vec3 pivot(random.get(3, 0), random.get(3, 1), random.get(3, 2));
+        const Mat4 sandwich = Mat4(pivot) * b.toMat4() * Mat4(pivot * -1) * a.toMat4();
+        const Mat4 projective = a.toMat4() * Mat4(1, 10, -1, 1, -1, 1);
+        if (difference(Affine3(), projective.inverse() * projective) > 1e-5f ||
+            difference(a * b, a.toMat4() * b.toMat4()) != 0 ||
+            difference(a.inverse() * a, Mat4()) > 1e-5f ||
+            difference(a.rotatedAbout(b, pivot), sandwich) > 1e-5f) { return false; }
+    }
+    return true;
+}
+
+static int mat4() {
+    const int iterations = 10000000;
+    const Mat4 rotation(2, Z);
+    Mat4 m(3, 4, 5);
+    Vec3 v(1, 2, 3);
+    float columns[16], sink = 0;
+
+    std::cout << "Mat4, " << iterations << " calls each" << std::endl;
+    mat4Case("operator*", iterations, [&] { m = rotation * m; });
+    mat4Case("operator~", iterations, [&] { m = ~m; });
+    mat4Case("transformVector", iterations, [&] { v = rotation.transformVector(v); });
+    mat4Case("pivot rotation (HW2b)", iterations, [&] {
+        Vec3 translation = m.getTranslationVec3();
+        m = Mat4(translation) * rotation * Mat4(translation * -1) * m;
+    });
+    mat4Case("inverse", iterations, [&] { m = m.inverse(); });
+    mat4Case("dumpColumnWise", iterations, [&] {
+        m.dumpColumnWise(columns);
+        sink += columns[15];
+    });
+
+    const Affine3 affineRotation = Affine3::rotation(2, Z);
+    Affine3 a = Affine3::translation(Vec3(0.5f, 0.25f, 0)) * Affine3::scale(3, 4, 5);
+    std::cout << "Affine3, " << iterations << " calls each" << std::endl;
+    mat4Case("operator*", iterations, [&] { a = affineRotation * a; });
+    mat4Case("inverse", iterations, [&] { a = a.inverse(); });
+    mat4Case("rotatedAbout (HW2b)", iterations, [&] { a = a.rotatedAbout(affineRotation, a.getTranslationVec3()); });
+    mat4Case("toMat4", iterations, [&] { sink += a.toMat4().data()[12]; });
+    volatile float keep = sink + m.get(0, 0) + v.x + a.get(0, 0); // so the loops aren't optimized away
+    (void) keep;
+
+    bool same = mat4MatchesLoops(), affineSame = affineMatchesMat4();
+    std::cout << "  Mat4 matches scalar loops:   " << (same ? "yes" : "NO") << "\n"
+              << "  Affine3 matches Mat4:        " << (affineSame ? "yes" : "NO") << std::endl;
+    return same && affineSame ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Runs op repeats times and prints the best throughput for moving bytes
+template<typename F>
+static void throughputCase(const std::string &name, size_t bytes, const F &op) {
+    double best = HUGE_VAL;
+    for (int r = 0; r < 5; ++r) {
+        double start = now();
+        op();
+        best = std::min(best, now() - start);
+    }
+    std::printf("  %-28s %8.3f ms, %6.2f GB/s\n", name.c_str(), best * 1000, bytes / best / 1e9);
+}
+
+// Times the batched transforms on n random points, false if any kernel differs from the scalar ones
+static bool transformSize(size_t n) {
+    std::vector<float> aos(3 * n), out(3 * n), expected(3 * n), soa(3 * n), soaOut(3 * n);
+    std::srand(1);
+    for (float &f : aos) { f = (float) std::rand() / RAND_MAX * 200 - 100; }
+    for (size_t p = 0; p < n; ++p) {
+        for (int a = 0; a < 3; ++a) { soa[a * n + p] = aos[3 * p + a]; }
+    }
+    const float *in[3] = {&soa[0], &soa[n], &soa[2 * n]};
+    float *const outs[3] = {&soaOut[0], &soaOut[n], &soaOut[2 * n]};
+    const Mat4 m = Mat4(30, Y) * Mat4(Vec3(1, 2, 3)) * Mat4(2, 3, 4);
+    float expectedLo[3], expectedHi[3];
+    transformPoints(m, &aos[0], &expected[0], n, SIMD_SCALAR);
+    boundingBox(&aos[0], n, expectedLo, expectedHi, SIMD_SCALAR);
+
+    bool same = true;
+    auto check = [&](bool soaLayout) {
+        for (size_t p = 0; p < n && same; ++p) {
+            for (int a = 0; a < 3; ++a) {
+                float v = soaLayout ? soaOut[a * n + p] : out[3 * p + a];
+                same = same && std::memcmp(&v, &expected[3 * p + a], sizeof(float)) == 0;
+            }
+        }
+    };
+
+    std::cout << "\n" << n << " points, " << n * 12 / 1e6 << " MB, best of 5" << std::endl;
+    const size_t bytes = n * 24;
+    for (int l = SIMD_SCALAR; l <= simdLevel(); ++l) {
+        const SimdLevel level = (SimdLevel) l;
+        const std::string name = simdLevelName(level);
+        throughputCase("AoS points, " + name, bytes, [&] { transformPoints(m, &aos[0], &out[0], n, level); });
+        check(false);
+        throughputCase("SoA points, " + name, bytes, [&] { transformPoints(m, in, outs, n, level); });
+        check(true);
+        throughputCase("bounding box, " + name, bytes / 2, [&] {
+            float lo[3], hi[3];
+            boundingBox(&aos[0], n, lo, hi, level);
+            same = same && std::memcmp(lo, expectedLo, sizeof(lo)) == 0 && std::memcmp(hi, expectedHi, sizeof(hi)) == 0;
+        });
+    }
+    const int numThreads = ThreadPool::global().size();
+    const std::string threads = std::to_string(numThreads) + (numThreads == 1 ? " thread" : " threads");
+    throughputCase("AoS points, " + threads, bytes, [&] { parallelTransformPoints(m, &aos[0], &out[0], n); });
+    check(false);
+    throughputCase("SoA points, " + threads, bytes, [&] { parallelTransformPoints(m, in, outs, n); });
+    check(true);
+    transformVectors(m, &aos[0], &expected[0], n, SIMD_SCALAR); // directions too, untimed
+    transformVectors(m, &aos[0], &out[0], n);
+    check(false);
+    parallelTransformVectors(m, in, outs, n);
+    check(true);
+    std::cout << "  identical:                   " << (same ? "yes" : "NO") << std::endl;
+    return same;
+}
+
+static int transform() {
+    std::cout << "SIMD level: " << simdLevelName(simdLevel()) << std::endl;
+    bool ok = transformSize(1 << 18); // about the vertices of Sponza
+    ok = transformSize(1 << 22) && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Runs f(context) with a width x height headless context current, once it
+// has printed what the context is. Fails if there is no context to be had.
+template<typename F>
+static int withHeadlessContext(int width, int height, const F &f) {
+    HeadlessContext context;
+    if (!context.create(width, height)) {
+        std::cerr << "No headless OpenGL context: " << context.error << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << context.backend << ", " << context.description() << ", " << width << "x" << height << " framebuffer"
+              << std::endl;
+    return f(context);
+}
+
+// shader.vert as it was before MatrixUniforms, the whole chain per vertex
+static const char *chainVertexShader = R"(#version 330 core
+layout(location=0) in vec3 in_position;
+layout(location=1) in vec3 in_color;
+layout(location=2) in vec3 in_normal;
+out vec3 vposition;
+out vec3 vcolor;
+out vec3 vnormal;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+void main()
+{
+    vec4 pos = projection * view *  model *  vec4(position_offset + position_scale * in_position, 1.0);
+    vcolor = in_color;
+    vnormal = in_normal;
+    vposition = vec3(pos);
+    gl_Position = pos;
+}
+)";
+
+// The variant the shader benchmarks draw with, what shader.vert and shader.frag were before variants
+const uint32_t BENCH_VARIANT = SHADER_TWO_SIDED | SHADER_VERTEX_COLORS;
+
+// shader.vert or shader.frag, preprocessed for the variant key
+static std::string shaderSource(const char *name, uint32_t key = BENCH_VARIANT) {
+    return addShaderDefines(preprocessShader(name), shaderVariantDefines(key));
+}
+
+// Draws frames until a second has passed, returns the seconds per frame
+template<typename F>
+static double drawFrames(const F &draw) {
+    for (int frame = 0; frame < 3; ++frame) { draw(); }
+    glFinish();
+    int frames = 0;
+    double start = now(), seconds = 0;
+    while (seconds < 1 || frames < 5) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        draw();
+        glFinish();
+        ++frames;
+        seconds = now() - start;
+    }
+    return seconds / frames;
+}
+
+// Times the mesh drawn as triangles, then only its vertices shaded: each once,
+// as points with rasterization off. Prints both and returns their seconds.
+static std::pair<double, double> drawCases(const char *name, GLsizei numVertices, GLsizei numIndices) {
+    const double triangles = drawFrames([&] { glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0); });
+    glEnable(GL_RASTERIZER_DISCARD);
+    const double vertices = drawFrames([&] { glDrawArrays(GL_POINTS, 0, numVertices); });
+    glDisable(GL_RASTERIZER_DISCARD);
+    std::printf("  %-28s %8.2f ms drawn, %8.2f ms vertex shading, %7.1f M vertices/s\n", name, triangles * 1000,
+                vertices * 1000, numVertices / vertices / 1e6);
+    return {triangles, vertices};
+}
+
+// Uploads positions, colors and normals to attributes 0, 1 and 2 of a new
+// vertex array, which is left bound, and the faces to buffers[3]
+static void uploadMesh(const TriMesh &mesh, GLuint &vao, GLuint buffers[4]) {
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(4, buffers);
+    const std::vector<Vec3f> *attributes[3] = {&mesh.vertices, &mesh.colors, &mesh.normals};
+    for (GLuint a = 0; a < 3; ++a) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[a]);
+        glBufferData(GL_ARRAY_BUFFER, attributes[a]->size() * sizeof(Vec3f), attributes[a]->data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(a);
+        glVertexAttribPointer(a, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), 0);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[3]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.faces.size() * sizeof(Vec3i), mesh.faces.data(), GL_STATIC_DRAW);
+}
+
+// Model matrix that fits the mesh into (-1,1), as the app does with --fit
+static Affine3 fitModel(const TriMesh &mesh) {
+    float lo[3], hi[3];
+    boundingBox(mesh.vertices[0].data, mesh.vertices.size(), lo, hi);
+    const float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    return Affine3::scale(2 / extent, 2 / extent, 2 / extent) *
+           Affine3::translation(Vec3(lo[0] + hi[0], lo[1] + hi[1], lo[2] + hi[2]) * -0.5f);
+}
+
+// Looks at the fitted mesh from 4 units away, at an angle
+static Affine3 benchView() {
+    return Affine3::translation(Vec3(0, 0, -4)) * Affine3::rotation(30, X) * Affine3::rotation(30, Y);
+}
+
+// Times both vertex shaders on one file, false if it can't be loaded or drawn
+static bool mvpFile(const std::string &file) {
+    TriMesh mesh;
+    if (!mesh.load_obj(file, 0, true)) { return false; }
+    mesh.need_normals();
+    mesh.need_colors();
+
+    GLuint vao, buffers[4];
+    uploadMesh(mesh, vao, buffers);
+    const Affine3 model = fitModel(mesh);
+    const Affine3 view = benchView();
+    const Mat4 projection(2, 6, -1, 1, -1, 1);
+    const std::string fragment = shaderSource("shader.frag");
+    const GLsizei numVertices = (GLsizei) mesh.vertices.size(), numIndices = (GLsizei) mesh.faces.size() * 3;
+    std::printf("\n%s\n  faces: %zu, vertices: %zu\n", file.c_str(), mesh.faces.size(), mesh.vertices.size());
+
+    mcl::Shader chain;
+    chain.init_from_strings(chainVertexShader, fragment);
+    chain.enable();
+    glUniformMatrix4fv(chain.uniform("model"), 1, GL_FALSE, model.toMat4().data());
+    glUniformMatrix4fv(chain.uniform("view"), 1, GL_FALSE, view.toMat4().data());
+    glUniformMatrix4fv(chain.uniform("projection"), 1, GL_FALSE, projection.data());
+    glUniform3f(chain.uniform("position_offset"), 0, 0, 0);
+    glUniform3f(chain.uniform("position_scale"), 1, 1, 1);
+    const std::pair<double, double> before = drawCases("projection * view * model", numVertices, numIndices);
+
+    mcl::Shader precomputed;
+    precomputed.init_from_strings(shaderSource("shader.vert"), fragment);
+    precomputed.enable();
+    precomputed.uniform_block("Frame", FRAME_BLOCK_BINDING);
+    UniformRing<FrameBlock> ring;
+    ring.init(FRAME_BLOCK_BINDING);
+    MatrixUniforms m;
+    double start = now();
+    m.update(projection, view, model, Affine3());
+    const double updateSeconds = now() - start;
+    ring.map()->set(model, view, projection, m, Camera());
+    ring.publish();
+    const std::pair<double, double> after = drawCases("mvp, mv, normal_matrix", numVertices, numIndices);
+    const bool drawn = glGetError() == GL_NO_ERROR;
+
+    glBindVertexArray(0);
+    glDeleteBuffers(4, buffers);
+    glDeleteVertexArrays(1, &vao);
+
+    std::printf("  %-28s %8.2fx drawn, %8.2fx vertex shading\n", "speedup", before.first / after.first,
+                before.second / after.second);
+    std::printf("  %-28s %8.2f us on the CPU\n", "MatrixUniforms::update", updateSeconds * 1e6);
+    return drawn;
+}
+
+// CPU time per frame to hand the matrices to a program: three glUniformMatrix4fv
+// as before the Frame block, with locations found by name, by compile time id and
+// by handle, or one write and bind of a ring slot
+static void uniformUpdates() {
+    const int frames = 100000;
+    const Affine3 model = Affine3::rotation(10, Y), view = Affine3::translation(Vec3(0, 0, -4));
+    const Mat4 projection(2, 6, -1, 1, -1, 1);
+    glEnable(GL_RASTERIZER_DISCARD);
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    mcl::Shader chain;
+    chain.init_from_strings(chainVertexShader, shaderSource("shader.frag"));
+    chain.enable();
+    float columns[16];
+    auto uniformFrames = [&](const char *name, const auto &location) {
+        const double start = now();
+        for (int frame = 0; frame < frames; ++frame) {
+            model.dumpColumnWise(columns);
+            glUniformMatrix4fv(location(0), 1, GL_FALSE, columns);
+            view.dumpColumnWise(columns);
+            glUniformMatrix4fv(location(1), 1, GL_FALSE, columns);
+            projection.dumpColumnWise(columns);
+            glUniformMatrix4fv(location(2), 1, GL_FALSE, columns);
+            glDrawArrays(GL_POINTS, 0, 1);
+            glFlush(); // as swapping buffers would
+        }
+        glFinish();
+        std::printf("  %-28s %8.2f us per frame\n", name, (now() - start) / frames * 1e6);
+    };
+    const char *names[3] = {"model", "view", "projection"};
+    const mcl::ShaderId ids[3] = {SHADER_ID("model"), SHADER_ID("view"), SHADER_ID("projection")};
+    const int handles[3] = {chain.uniform_handle("model"), chain.uniform_handle("view"), chain.uniform_handle("projection")};
+    std::unordered_map<std::string, GLuint> map; // how Shader::uniform looked locations up before reflection
+    auto mapLocation = [&](const std::string name) {
+        if (map.count(name) == 0) { map[name] = chain.uniform(name); }
+        return map[name];
+    };
+    std::printf("\nUniform updates and a one point draw, %d frames\n", frames);
+    uniformFrames("uniforms by name, string map", [&](int k) { return mapLocation(names[k]); });
+    uniformFrames("uniforms by name", [&](int k) { return chain.uniform(names[k]); });
+    uniformFrames("uniforms by id", [&](int k) { return chain.uniform(ids[k]); });
+    uniformFrames("uniforms by handle", [&](int k) { return chain.uniform(handles[k]); });
+
+    mcl::Shader precomputed;
+    precomputed.init_from_strings(shaderSource("shader.vert"), shaderSource("shader.frag"));
+    precomputed.enable();
+    precomputed.uniform_block("Frame", FRAME_BLOCK_BINDING);
+    UniformRing<FrameBlock> ring;
+    ring.init(FRAME_BLOCK_BINDING);
+    MatrixUniforms m;
+    const Camera camera;
+    const double start = now();
+    for (int frame = 0; frame < frames; ++frame) {
+        m.update(projection, view, model, Affine3());
+        ring.map()->set(model, view, projection, m, camera);
+        ring.publish();
+        glDrawArrays(GL_POINTS, 0, 1);
+        glFlush();
+    }
+    glFinish();
+    const double ringSeconds = (now() - start) / frames;
+
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vao);
+    glDisable(GL_RASTERIZER_DISCARD);
+    std::printf("  %-28s %8.2f us per frame, %zu stalls\n", "Frame block ring", ringSeconds * 1e6, ring.stalls);
+
+    // The lookups alone, without GL calls
+    const int lookups = 10000000;
+    GLuint sink = 0;
+    std::printf("Location lookups, %d each\n", lookups);
+    mat4Case("string map", lookups, [&] { sink += mapLocation(names[sink % 3]); });
+    mat4Case("name", lookups, [&] { sink += chain.uniform(names[sink % 3]); });
+    mat4Case("id", lookups, [&] { sink += chain.uniform(ids[sink % 3]); });
+    mat4Case("handle", lookups, [&] { sink += chain.uniform(handles[sink % 3]); });
+    volatile GLuint keep = sink;
+    (void) keep;
+}
+
+// Seconds to set shader.vert and shader.frag up and draw a point with them. A
+// comment with variant makes the sources new to the driver and its caches.
+// Adds false to ok if the program came from the binary cache or not when it shouldn't.
+static double shaderSetup(const std::string &cache, const std::string &variant, bool expectBinary, bool &ok) {
+    static const std::string vertex = shaderSource("shader.vert");
+    static const std::string fragment = shaderSource("shader.frag");
+    mcl::Shader shader;
+    const double start = now();
+    if (!cache.empty()) { shader.use_binary_cache(cache); }
+    shader.init_from_strings(vertex + "// " + variant + "\n", fragment);
+    shader.enable();
+    shader.uniform_block("Frame", FRAME_BLOCK_BINDING);
+    glDrawArrays(GL_POINTS, 0, 1); // drivers may finish compiling at the first draw
+    glFinish();
+    const double seconds = now() - start;
+    ok = ok && shader.from_binary_cache() == expectBinary;
+    return seconds;
+}
+
+// What startup with variants of the shaders looks like, seconds
+struct AsyncStartup {
+    double firstFrame = 0; // placeholder, or the real one if nothing is async
+    double longestFrame = 0; // between frames while the shaders build
+    double allDrawn = 0; // every variant has drawn once
+    int placeholders = 0;
+};
+
+// Builds variants of shader.vert and shader.frag, blocking or async on worker
+// or the driver, and draws placeholder frames until they are all ready
+static AsyncStartup asyncStartup(int variants, const std::string &run, bool async, mcl::ShaderWorker *worker) {
+    static const std::string vertex = shaderSource("shader.vert");
+    static const std::string fragment = shaderSource("shader.frag");
+    AsyncStartup result;
+    const double start = now();
+    std::vector<mcl::Shader> shaders(variants);
+    for (int v = 0; v < variants; ++v) {
+        const std::string source = vertex + "// variant " + std::to_string(v) + " of " + run + "\n";
+        if (async) {
+            shaders[v].init_from_strings_async(source, fragment, worker);
+        } else {
+            shaders[v].init_from_strings(source, fragment);
+        }
+    }
+
+    // Placeholder frames, a clear the way the app draws them
+    double lastFrame = start;
+    for (;;) {
+        bool ready = true;
+        for (mcl::Shader &shader : shaders) { ready = shader.ready() && ready; }
+        if (ready && result.placeholders > 0) { break; }
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glFinish();
+        const double t = now();
+        if (result.placeholders++ == 0) { result.firstFrame = t - start; }
+        result.longestFrame = std::max(result.longestFrame, t - lastFrame);
+        lastFrame = t;
+        if (ready) { break; }
+    }
+
+    // The first real draws, where drivers may still have work to do
+    for (mcl::Shader &shader : shaders) {
+        shader.enable();
+        shader.uniform_block("Frame", FRAME_BLOCK_BINDING);
+        glDrawArrays(GL_POINTS, 0, 1);
+    }
+    glFinish();
+    result.allDrawn = now() - start;
+    return result;
+}
+
+#ifdef HAVE_EGL
+
+// Seconds until all variants have been built through ShaderVariants, with
+// workers threads on contexts shared with context, and drawn once each
+static double precompileVariants(HeadlessContext &context, int workers, const std::string &run) {
+    std::vector<EGLContext> shared;
+    std::vector<std::unique_ptr<mcl::ShaderWorker>> threads;
+    std::vector<mcl::ShaderWorker *> pointers;
+    for (int w = 0; w < workers; ++w) {
+        shared.push_back(context.createShared());
+        threads.emplace_back(new mcl::ShaderWorker());
+        threads.back()->preferred = true;
+        EGLContext c = shared.back();
+        threads.back()->start([&context, c] { context.makeCurrent(c); }, [&context] { context.makeCurrent(EGL_NO_CONTEXT); });
+        pointers.push_back(threads.back().get());
+    }
+
+    // A file per run keeps the driver's caches cold
+    const std::string dir = (std::filesystem::temp_directory_path() / "hw2c_variants").string();
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir + "/shader.vert") << preprocessShader("shader.vert") << "// " << run << "\n";
+    std::ofstream(dir + "/shader.frag") << preprocessShader("shader.frag");
+
+    const double start = now();
+    ShaderVariants variants;
+    variants.onReady = [](mcl::Shader &shader) { shader.uniform_block("Frame", FRAME_BLOCK_BINDING); };
+    variants.init("shader.vert", "shader.frag", dir);
+    variants.setWorkers(pointers);
+    std::vector<uint32_t> keys;
+    for (uint32_t key = 0; key < SHADER_NUM_VARIANTS; ++key) { keys.push_back(key); }
+    variants.precompile(keys);
+    for (uint32_t key : keys) {
+        variants.use(key);
+        glDrawArrays(GL_POINTS, 0, 1);
+    }
+    glFinish();
+    const double seconds = now() - start;
+
+    for (auto &thread : threads) { thread->stop(); }
+    for (EGLContext c : shared) { context.destroyShared(c); }
+    std::filesystem::remove_all(dir);
+    return seconds;
+}
+
+#endif // HAVE_EGL
+
+static int variants() {
+#ifdef HAVE_EGL
+    return withHeadlessContext(512, 512, [&](HeadlessContext &context) {
+
+        // Building all of them
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glEnable(GL_RASTERIZER_DISCARD);
+        const std::string run = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+        std::printf("All %u variants built and drawn once\n", SHADER_NUM_VARIANTS);
+        for (int workers : {0, 1, 2, 4}) {
+            const double seconds = precompileVariants(context, workers, run + " " + std::to_string(workers));
+            std::printf("  %-28s %8.2f ms\n", workers == 0 ? "no worker" : (std::to_string(workers) + (workers == 1 ? " worker" : " workers")).c_str(),
+                        seconds * 1000);
+        }
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(0);
+        glDeleteVertexArrays(1, &vao);
+
+        // What the features cost, on a grid filling the framebuffer
+        const std::string grid = (std::filesystem::temp_directory_path() / "hw2c_variants_grid.obj").string();
+        TriMesh mesh;
+        const bool loaded = writeGridObj(grid, 16) && mesh.load_obj(grid, 0, true);
+        std::remove(grid.c_str());
+        if (!loaded) {
+            std::cerr << "Could not write and load " << grid << std::endl;
+            return EXIT_FAILURE;
+        }
+        mesh.need_normals();
+        mesh.need_colors();
+        GLuint buffers[4];
+        uploadMesh(mesh, vao, buffers);
+        const Affine3 model = fitModel(mesh), view = Affine3::translation(Vec3(0, 0, -2.5f)) * Affine3::rotation(-60, X);
+        const Mat4 projection(1, 6, -1, 1, -1, 1);
+        UniformRing<FrameBlock> ring;
+        ring.init(FRAME_BLOCK_BINDING);
+        MatrixUniforms m;
+        m.update(projection, view, model, Affine3());
+        ring.map()->set(model, view, projection, m, Camera());
+        ring.publish();
+
+        ShaderVariants variants;
+        variants.onReady = [](mcl::Shader &shader) {
+            shader.uniform_block("Frame", FRAME_BLOCK_BINDING);
+            const int baseColor = shader.uniform_handle("base_color");
+            if (baseColor >= 0) { glUniform3f(shader.uniform(baseColor), 0.3f, 0.3f, 0.3f); }
+        };
+        variants.init("shader.vert", "shader.frag");
+        const uint32_t keys[] = {shaderVariant(SHADER_TWO_SIDED | SHADER_VERTEX_COLORS, 1),
+                                 shaderVariant(SHADER_VERTEX_COLORS, 1), shaderVariant(0, 1),
+                                 shaderVariant(SHADER_TWO_SIDED | SHADER_VERTEX_COLORS, 4), shaderVariant(0, 4)};
+        std::vector<uint32_t> keyList(std::begin(keys), std::end(keys));
+        variants.precompile(keyList);
+        const GLsizei numIndices = (GLsizei) mesh.faces.size() * 3;
+        const int layers = 8; // drawn over each other without depth test, so shading fragments is the work
+        std::printf("%zu faces filling the framebuffer %d times, per frame\n", mesh.faces.size(), layers);
+        double first = 0;
+        for (uint32_t key : keys) {
+            variants.use(key);
+            const double seconds = drawFrames([&] {
+                for (int layer = 0; layer < layers; ++layer) { glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0); }
+            });
+            if (first == 0) { first = seconds; }
+            std::printf("  %-36s %8.2f ms (%.2fx)\n", shaderVariantName(key).c_str(), seconds * 1000, first / seconds);
+        }
+        const bool ok = glGetError() == GL_NO_ERROR;
+        glBindVertexArray(0);
+        glDeleteBuffers(4, buffers);
+        glDeleteVertexArrays(1, &vao);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    });
+#else
+    std::cerr << "Built without EGL, variants needs it for a context without a window" << std::endl;
+    return EXIT_FAILURE;
+#endif
+}
+
+static int asyncShaders() {
+#ifdef HAVE_EGL
+    return withHeadlessContext(64, 64, [&](HeadlessContext &context) {
+        std::cout << "Parallel shader compile: " << (mcl::Shader::parallel_compile_supported() ? "yes" : "no") << std::endl;
+        EGLContext shared = context.createShared();
+        if (shared == EGL_NO_CONTEXT) {
+            std::cerr << "No shared context for the worker" << std::endl;
+            return EXIT_FAILURE;
+        }
+        mcl::ShaderWorker worker;
+        worker.preferred = true;
+        worker.start([&] { context.makeCurrent(shared); }, [&] { context.makeCurrent(EGL_NO_CONTEXT); });
+
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glEnable(GL_RASTERIZER_DISCARD);
+        const int variants = 16, rounds = 5;
+        const std::string run = std::to_string(std::chrono::system_clock::now().time_since_epoch().count()); // new to disk caches too
+        const char *names[3] = {"blocking", "async, driver", "async, worker"};
+        AsyncStartup sums[3];
+        for (int r = 0; r < rounds; ++r) {
+            for (int how = 0; how < 3; ++how) {
+                const AsyncStartup s = asyncStartup(variants, run + " " + std::to_string(r) + " " + std::to_string(how),
+                                                    how > 0, how == 2 ? &worker : nullptr);
+                sums[how].firstFrame += s.firstFrame / rounds;
+                sums[how].longestFrame += s.longestFrame / rounds;
+                sums[how].allDrawn += s.allDrawn / rounds;
+                sums[how].placeholders += s.placeholders;
+            }
+        }
+        worker.stop();
+        context.destroyShared(shared);
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(0);
+        glDeleteVertexArrays(1, &vao);
+
+        std::printf("%d variants of shader.vert and shader.frag, mean of %d\n", variants, rounds);
+        std::printf("  %-16s %12s %14s %12s %13s\n", "", "first frame", "longest frame", "all drawn", "placeholders");
+        for (int how = 0; how < 3; ++how) {
+            std::printf("  %-16s %9.2f ms %11.2f ms %9.2f ms %13.1f\n", names[how], sums[how].firstFrame * 1000,
+                        sums[how].longestFrame * 1000, sums[how].allDrawn * 1000, (double) sums[how].placeholders / rounds);
+        }
+        return EXIT_SUCCESS;
+    });
+#else
+    std::cerr << "Built without EGL, async-shaders needs it for a context without a window" << std::endl;
+    return EXIT_FAILURE;
+#endif
+}
+
+static int shaders() {
+    return withHeadlessContext(64, 64, [&](HeadlessContext &) {
+        if (!programBinariesSupported()) {
+            std::cerr << "The driver has no program binary formats" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const std::string cache = (std::filesystem::temp_directory_path() / "hw2c_shader_cache").string();
+        std::filesystem::remove_all(cache);
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glEnable(GL_RASTERIZER_DISCARD);
+        const int rounds = 10;
+        const std::string run = std::to_string(std::chrono::system_clock::now().time_since_epoch().count()); // new to disk caches too
+        double source = 0, cold = 0, warm = 0;
+        bool ok = true;
+        for (int r = 0; r < rounds; ++r) {
+            const std::string round = std::to_string(r) + " of run " + run;
+            source += shaderSetup("", "source " + round, false, ok);
+            cold += shaderSetup(cache, "cached " + round, false, ok);
+            warm += shaderSetup(cache, "cached " + round, true, ok);
+
+            // Flip the bytes of the binaries, the driver has to refuse them and the program is compiled and saved again
+            for (const auto &entry : std::filesystem::directory_iterator(cache)) {
+                FILE *fp = std::fopen(entry.path().c_str(), "r+b");
+                if (fp == nullptr) { continue; }
+                std::vector<char> bytes(std::filesystem::file_size(entry.path()));
+                ok = ok && std::fread(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+                for (size_t i = sizeof(ProgramCacheHeader); i < bytes.size(); ++i) { bytes[i] = ~bytes[i]; }
+                std::fseek(fp, 0, SEEK_SET);
+                ok = ok && std::fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+                std::fclose(fp);
+            }
+            shaderSetup(cache, "cached " + round, false, ok);
+            shaderSetup(cache, "cached " + round, true, ok);
+        }
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(0);
+        glDeleteVertexArrays(1, &vao);
+        std::filesystem::remove_all(cache);
+
+        std::printf("shader.vert and shader.frag up to the first draw, mean of %d\n", rounds);
+        std::printf("  %-28s %8.2f ms\n", "from source, no cache", source / rounds * 1000);
+        std::printf("  %-28s %8.2f ms\n", "cold, compile and save", cold / rounds * 1000);
+        std::printf("  %-28s %8.2f ms (%.1fx)\n", "warm, load binary", warm / rounds * 1000, source / warm);
+        std::cout << "  corrupt binaries rebuilt:    " << (ok ? "yes" : "NO") << std::endl;
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    });
+}
+
+static int mvp(int argc, char *argv[]) {
+    return withHeadlessContext(64, 64, [&](HeadlessContext &) {
+        glEnable(GL_DEPTH_TEST);
+        uniformUpdates();
+
+        std::string grid;
+        std::vector<std::string> files = benchFiles(argc, argv, grid);
+        bool ok = !files.empty();
+        for (const std::string &file : files) { ok = mvpFile(file) && ok; }
+        if (!grid.empty()) { std::remove(grid.c_str()); }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    });
+}
+
+} // end namespace bench
+
+int main(int argc, char *argv[]) {
+    const std::string name = argc > 1 ? argv[1] : "";
+    if (name == "load") { return bench::loadObj(argc - 2, argv + 2); }
+    if (name == "normals") { return bench::normals(argc - 2, argv + 2); }
+    if (name == "mat4") { return bench::mat4(); }
+    if (name == "transform") { return bench::transform(); }
+    if (name == "shaders") { return bench::shaders(); }
+    if (name == "async-shaders") { return bench::asyncShaders(); }
+    if (name == "variants") { return bench::variants(); }
+    if (name == "mvp") { return bench::mvp(argc - 2, argv + 2); }
+    std::cerr << "Usage: HW2c-bench load|normals|mat4|transform|shaders|async-shaders|variants|mvp [file.obj ...]" << std::endl;
+    return EXIT_FAILURE;
+}
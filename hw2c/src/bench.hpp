@@ -0,0 +1,37 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+//
+//	Timing shared by the app and the benchmarks, which are in bench.cpp and
+//	built as HW2c-bench.
+//
+
+namespace bench {
+
+// Wall clock time in seconds
+inline double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Prints the mean, median, 95th and 99th percentile and extremes of the
+// frame times seconds, and the triangles per second the mean makes
+inline void printFrameTimes(std::vector<double> seconds, size_t triangles) {
+    if (seconds.empty()) { return; }
+    std::sort(seconds.begin(), seconds.end());
+    double total = 0;
+    for (double s : seconds) { total += s; }
+    const double mean = total / seconds.size();
+    auto percentile = [&](double p) { return seconds[std::min(seconds.size() - 1, (size_t) (p * seconds.size()))]; };
+    std::printf("%zu frames: %.2f ms mean (%.1f fps), p50 %.2f, p95 %.2f, p99 %.2f, min %.2f, max %.2f ms, %.1f M triangles/s\n",
+                seconds.size(), mean * 1000, 1 / mean, percentile(0.5) * 1000, percentile(0.95) * 1000,
+                percentile(0.99) * 1000, seconds.front() * 1000, seconds.back() * 1000, triangles / mean / 1e6);
+}
+
+} // end namespace bench
+
+#endif
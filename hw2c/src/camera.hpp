@@ -0,0 +1,200 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "affine3.hpp"
+#include "vec3.hpp"
+
+//
+//	Camera with its orientation kept as a unit quaternion, instead of a view
+//	direction that is rotated by a matrix on every key press. Turning is one
+//	quaternion product, a Newton step keeps it unit length without a square
+//	root, and the view matrix is built from it once per frame. Poses slerp
+//	smoothly into each other, which is what flythroughs are made of.
+//
+
+struct Quat {
+    float w = 1, x = 0, y = 0, z = 0;
+
+    Quat() = default;
+
+    Quat(float w, float x, float y, float z) : w(w), x(x), y(y), z(z) {}
+
+    // Rotation by angleInDegrees about a unit axis
+    static Quat axisAngle(const Vec3 &axis, float angleInDegrees) {
+        const float half = angleInDegrees / 360 * M_PI, s = std::sin(half);
+        return Quat(std::cos(half), axis.x * s, axis.y * s, axis.z * s);
+    }
+
+    // Rotation whose matrix has the orthonormal columns u, v and n
+    static Quat fromBasis(const Vec3 &u, const Vec3 &v, const Vec3 &n) {
+        const float trace = u.x + v.y + n.z;
+        if (trace > 0) {
+            const float s = std::sqrt(trace + 1) * 2;
+            return Quat(s / 4, (v.z - n.y) / s, (n.x - u.z) / s, (u.y - v.x) / s);
+        } else if (u.x > v.y && u.x > n.z) {
+            const float s = std::sqrt(1 + u.x - v.y - n.z) * 2;
+            return Quat((v.z - n.y) / s, s / 4, (v.x + u.y) / s, (n.x + u.z) / s);
+        } else if (v.y > n.z) {
+            const float s = std::sqrt(1 + v.y - u.x - n.z) * 2;
+            return Quat((n.x - u.z) / s, (v.x + u.y) / s, s / 4, (n.y + v.z) / s);
+        } else {
+            const float s = std::sqrt(1 + n.z - u.x - v.y) * 2;
+            return Quat((u.y - v.x) / s, (n.x + u.z) / s, (n.y + v.z) / s, s / 4);
+        }
+    }
+
+    // Compose, the result rotates by b first and then by this
+    Quat operator*(const Quat &b) const {
+        return Quat(w * b.w - x * b.x - y * b.y - z * b.z,
+                    w * b.x + x * b.w + y * b.z - z * b.y,
+                    w * b.y - x * b.z + y * b.w + z * b.x,
+                    w * b.z + x * b.y - y * b.x + z * b.w);
+    }
+
+    float dot(const Quat &b) const {
+        return w * b.w + x * b.x + y * b.y + z * b.z;
+    }
+
+    // Unit length again after rounding, for quaternions that are already close to it
+    Quat renormalized() const {
+        const float k = 1.5f - 0.5f * dot(*this);
+        return Quat(w * k, x * k, y * k, z * k);
+    }
+
+    Quat normalized() const {
+        const float k = 1 / std::sqrt(dot(*this));
+        return Quat(w * k, x * k, y * k, z * k);
+    }
+
+    Vec3 rotate(const Vec3 &v) const {
+        const Vec3 q(x, y, z), t = q.cross(v) * 2;
+        return v + t * w + q.cross(t);
+    }
+};
+
+// Interpolates at constant angular speed along the shorter arc, t in [0, 1]
+static Quat slerp(const Quat &a, Quat b, float t) {
+    float c = a.dot(b);
+    if (c < 0) {
+        b = Quat(-b.w, -b.x, -b.y, -b.z);
+        c = -c;
+    }
+    float wa = 1 - t, wb = t;
+    if (c < 0.9995f) { // nearly parallel ones are lerped, sin(angle) would be close to 0
+        const float angle = std::acos(c), s = std::sin(angle);
+        wa = std::sin((1 - t) * angle) / s;
+        wb = std::sin(t * angle) / s;
+    }
+    return Quat(wa * a.w + wb * b.w, wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z).normalized();
+}
+
+struct CameraPose {
+    Vec3 position;
+    Quat orientation; // camera to world, the camera looks down its -z
+
+    // Pose looking yaw degrees left of -z and pitch degrees up, without roll
+    static CameraPose fromYawPitch(const Vec3 &position, float yaw, float pitch) {
+        return {position, Quat::axisAngle(Vec3(0, 1, 0), yaw) * Quat::axisAngle(Vec3(1, 0, 0), pitch)};
+    }
+};
+
+class Camera {
+public:
+    CameraPose pose;
+
+    Camera() = default;
+
+    Camera(const Vec3 &eye, const Vec3 &viewDir, const Vec3 &upDir) {
+        lookAt(eye, viewDir, upDir);
+    }
+
+    void lookAt(const Vec3 &eye, const Vec3 &viewDir, const Vec3 &upDir) {
+        const Vec3 n = viewDir.unit() * -1;
+        const Vec3 u = upDir.unit().cross(n).unit();
+        const Vec3 v = n.cross(u);
+        pose.position = eye;
+        pose.orientation = Quat::fromBasis(u, v, n);
+    }
+
+    // Turns left about the world up axis, +y
+    void yaw(float angleInDegrees) {
+        pose.orientation = (Quat::axisAngle(Vec3(0, 1, 0), angleInDegrees) * pose.orientation).renormalized();
+    }
+
+    // Tilts up about the camera's own right axis
+    void pitch(float angleInDegrees) {
+        pose.orientation = (pose.orientation * Quat::axisAngle(Vec3(1, 0, 0), angleInDegrees)).renormalized();
+    }
+
+    void moveForward(float distance) {
+        pose.position = pose.position + viewDirection() * distance;
+    }
+
+    Vec3 eye() const {
+        return pose.position;
+    }
+
+    Vec3 viewDirection() const {
+        return pose.orientation.rotate(Vec3(0, 0, -1));
+    }
+
+    // Inverse of the pose: the rows of the rotation are the camera axes
+    Affine3 viewMatrix() const {
+        const Quat &q = pose.orientation;
+        const Vec3 u(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.w * q.z), 2 * (q.x * q.z - q.w * q.y));
+        const Vec3 v(2 * (q.x * q.y - q.w * q.z), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z + q.w * q.x));
+        const Vec3 n(2 * (q.x * q.z + q.w * q.y), 2 * (q.y * q.z - q.w * q.x), 1 - 2 * (q.x * q.x + q.y * q.y));
+        const Vec3 &p = pose.position;
+        return Affine3::view(u, v, n, Vec3(-p.dot(u), -p.dot(v), -p.dot(n)));
+    }
+
+    // The pose as a flythrough line, x y z yaw pitch
+    std::string poseLine() const {
+        const Vec3 f = viewDirection();
+        std::ostringstream line;
+        line << pose.position.x << " " << pose.position.y << " " << pose.position.z << " "
+             << std::atan2(-f.x, -f.z) * 180 / M_PI << " " << std::asin(std::max(-1.f, std::min(f.y, 1.f))) * 180 / M_PI;
+        return line.str();
+    }
+};
+
+// Camera path through key poses, a few seconds apart, that loops back to the first
+class Flythrough {
+public:
+    std::vector<CameraPose> keys;
+    float secondsPerKey = 3;
+
+    // Reads a pose per line, as written by Camera::poseLine. Lines starting with # are skipped.
+    bool load(const std::string &file) {
+        std::ifstream in(file);
+        if (!in) { return false; }
+        keys.clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') { continue; }
+            std::istringstream fields(line);
+            float x, y, z, yaw, pitch;
+            if (!(fields >> x >> y >> z >> yaw >> pitch)) { return false; }
+            keys.push_back(CameraPose::fromYawPitch(Vec3(x, y, z), yaw, pitch));
+        }
+        return !keys.empty();
+    }
+
+    // Pose seconds into the flythrough, positions are lerped and orientations slerped
+    CameraPose at(double seconds) const {
+        if (keys.size() < 2) { return keys.empty() ? CameraPose() : keys[0]; }
+        const double position = std::fmod(std::max(seconds, 0.0) / secondsPerKey, (double) keys.size());
+        const size_t k = (size_t) position;
+        const float t = (float) (position - k);
+        const CameraPose &a = keys[k], &b = keys[(k + 1) % keys.size()];
+        return {a.position * (1 - t) + b.position * t, slerp(a.orientation, b.orientation, t)};
+    }
+};
+
+#endif
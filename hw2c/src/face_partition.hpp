@@ -0,0 +1,59 @@
+#ifndef FACE_PARTITION_HPP
+#define FACE_PARTITION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "trimesh.hpp"
+
+//
+//	Spatial partition of the faces of a mesh into groups of nearby triangles,
+//	by splitting at the median centroid along the longest axis (a kd tree).
+//	Mesh processing uses the groups to run on all cores with good locality.
+//
+
+namespace face_partition_detail {
+
+static void split(const std::vector<Vec3f> &centroids, std::vector<int> &order, size_t begin, size_t end,
+                  size_t maxFaces, std::vector<std::pair<size_t, size_t>> &ranges) {
+    if (end - begin <= maxFaces) {
+        ranges.emplace_back(begin, end);
+        return;
+    }
+    float lo[3] = {HUGE_VALF, HUGE_VALF, HUGE_VALF}, hi[3] = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+    for (size_t i = begin; i < end; ++i) {
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], centroids[order[i]][a]);
+            hi[a] = std::max(hi[a], centroids[order[i]][a]);
+        }
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; ++a) { if (hi[a] - lo[a] > hi[axis] - lo[axis]) { axis = a; } }
+    size_t mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+    split(centroids, order, begin, mid, maxFaces, ranges);
+    split(centroids, order, mid, end, maxFaces, ranges);
+}
+
+} // end namespace face_partition_detail
+
+// Splits the faces into groups of at most maxFaces. order is a permutation of the
+// face ids and each range [first, second) of it is one group.
+static void partitionFaces(const MeshView &mesh, size_t maxFaces, std::vector<int> &order,
+                           std::vector<std::pair<size_t, size_t>> &ranges) {
+    std::vector<Vec3f> centroids(mesh.num_faces);
+    order.resize(mesh.num_faces);
+    ranges.clear();
+    for (size_t f = 0; f < mesh.num_faces; ++f) {
+        const Vec3i &t = mesh.faces[f];
+        for (int i = 0; i < 3; ++i) {
+            centroids[f][i] = (mesh.vertices[t[0]][i] + mesh.vertices[t[1]][i] + mesh.vertices[t[2]][i]) / 3;
+        }
+        order[f] = f;
+    }
+    if (mesh.num_faces > 0) { face_partition_detail::split(centroids, order, 0, order.size(), maxFaces, ranges); }
+}
+
+#endif
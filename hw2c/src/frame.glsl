@@ -0,0 +1,14 @@
+// Written once per change into a ring of uniform buffer slots, see FrameBlock.
+// mvp and mv are built on the CPU instead of multiplying the chain for every
+// vertex. Quantized positions are in [0,1] within the mesh bounding box, the
+// dequantization is folded into mv and mvp.
+layout(std140) uniform Frame {
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+    mat4 mvp;
+    mat4 mv;
+    mat3 normal_matrix;
+    vec4 eye; // camera position, world space
+    vec4 view_direction;
+};
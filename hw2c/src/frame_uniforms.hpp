@@ -0,0 +1,139 @@
+#ifndef FRAME_UNIFORMS_HPP
+#define FRAME_UNIFORMS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "affine3.hpp"
+#include "camera.hpp"
+#include "mat4.hpp"
+
+//
+//	Per frame uniform block in a ring of buffer slots. Instead of a name
+//	lookup and a glUniform call per matrix, the frame's matrices and camera
+//	are written into the next slot of one buffer and bound with a single
+//	glBindBufferRange. Slots are mapped unsynchronized, so the driver never
+//	stalls or copies; a fence put in when the ring moves on from a slot makes
+//	sure the GPU is done reading it before it is written again. Frames that
+//	change nothing keep the bound slot and cost nothing. Persistent mapping
+//	would need GL 4.4, this works on the 3.3 core context the window and the
+//	headless mode ask for.
+//
+
+// Binding point of the Frame block, the same in every program that declares it
+static const GLuint FRAME_BLOCK_BINDING = 0;
+
+// The Frame block of shader.vert, laid out the std140 way
+struct FrameBlock {
+    float model[16];
+    float view[16];
+    float projection[16];
+    float mvp[16];
+    float mv[16];
+    float normalMatrix[12]; // mat3, each column padded to a vec4
+    float eye[4];           // camera position, world space
+    float viewDirection[4]; // world space, unit length
+
+    void set(const Affine3 &modelMatrix, const Affine3 &viewMatrix, const Mat4 &projectionMatrix,
+             const MatrixUniforms &matrices, const Camera &camera) {
+        modelMatrix.dumpColumnWise(model);
+        viewMatrix.dumpColumnWise(view);
+        projectionMatrix.dumpColumnWise(projection);
+        matrices.mvp.dumpColumnWise(mvp);
+        matrices.mv.dumpColumnWise(mv);
+        for (int j = 0; j < 3; ++j) {
+            std::memcpy(normalMatrix + j * 4, matrices.normalMatrix + j * 3, 3 * sizeof(float));
+            normalMatrix[j * 4 + 3] = 0;
+        }
+        const Vec3 e = camera.eye(), d = camera.viewDirection();
+        const float eyeValues[4] = {e.x, e.y, e.z, 1}, directionValues[4] = {d.x, d.y, d.z, 0};
+        std::memcpy(eye, eyeValues, sizeof(eye));
+        std::memcpy(viewDirection, directionValues, sizeof(viewDirection));
+    }
+};
+
+static_assert(sizeof(FrameBlock) == 5 * 64 + 48 + 2 * 16, "FrameBlock must match the std140 Frame block");
+
+template<typename Block>
+class UniformRing {
+public:
+    // Frames in flight, the GPU may still read the slots of the two before this one
+    static const int numSlots = 3;
+
+    UniformRing() = default;
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    ~UniformRing() {
+        for (GLsync &fence : fences) {
+            if (fence) { glDeleteSync(fence); }
+        }
+        if (buffer) { glDeleteBuffers(1, &buffer); }
+    }
+
+    // Creates the buffer, with slots spaced by the uniform buffer offset alignment
+    void init(GLuint bindingPoint) {
+        binding = bindingPoint;
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        slotSize = (sizeof(Block) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, slotSize * numSlots, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Moves to the next slot and maps it for writing, waiting first if
+    // the GPU may still be reading it. Call publish once it is written.
+    // If the map fails it returns a copy in memory instead, which publish
+    // writes with glBufferSubData, so it is never null.
+    Block *map() {
+        if (published) { fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); } // after its last draw
+        slot = (slot + 1) % numSlots;
+        if (fences[slot]) {
+            if (glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED) {
+                ++stalls;
+                while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            }
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        mapped = (Block *) glMapBufferRange(GL_UNIFORM_BUFFER, slot * slotSize, sizeof(Block),
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped) { return mapped; }
+        if (mapFailures++ == 0) {
+            std::fprintf(stderr, "**Warning: Could not map the uniform buffer (GL error 0x%x), writing it with glBufferSubData\n",
+                         glGetError());
+        }
+        return &unmapped;
+    }
+
+    // Unmaps the slot, or writes it if map couldn't, and binds it, the one bind of the frame
+    void publish() {
+        if (mapped) { glUnmapBuffer(GL_UNIFORM_BUFFER); }
+        else { glBufferSubData(GL_UNIFORM_BUFFER, slot * slotSize, sizeof(Block), &unmapped); }
+        mapped = nullptr;
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, slot * slotSize, sizeof(Block));
+        published = true;
+    }
+
+    // Times map had to wait for the GPU, more frames in flight would avoid those
+    size_t stalls = 0;
+
+    // Times map failed and the slot was written with glBufferSubData
+    size_t mapFailures = 0;
+
+private:
+    GLuint buffer = 0, binding = 0;
+    size_t slotSize = 0;
+    int slot = numSlots - 1;
+    bool published = false;
+    GLsync fences[numSlots] = {};
+    Block *mapped = nullptr;
+    Block unmapped; // written in place of the slot when it can't be mapped
+};
+
+#endif
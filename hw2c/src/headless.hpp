@@ -0,0 +1,196 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+//
+//	OpenGL context without a window or a display, for rendering on machines
+//	with no GPU and no X server, and for benchmarks. It uses EGL on Mesa's
+//	surfaceless platform when CMake found EGL, which falls back to llvmpipe
+//	when there is no GPU. Otherwise it asks GLFW for an invisible window with
+//	an OSMesa context, and last for a plain invisible window. Either way it
+//	renders into a framebuffer object, which can be read back and saved.
+//
+
+#ifdef HAVE_EGL
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function" // the writers other than stbi_write_png
+#endif
+#include "glfw/deps/stb_image_write.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+class HeadlessContext {
+public:
+    GLuint framebuffer = 0, colorBuffer = 0, depthBuffer = 0;
+    int width = 0, height = 0;
+    std::string error; // why create failed
+    const char *backend = ""; // which kind of context create made
+
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    ~HeadlessContext() { destroy(); }
+
+    // Makes an OpenGL 3.3 core context current, with a width x height
+    // framebuffer bound and viewport set. False with error set if it can't.
+    bool create(int w, int h) {
+#ifdef HAVE_EGL
+        if (createEgl()) { return createFramebuffer(w, h); }
+        const std::string eglError = error;
+#else
+        const std::string eglError = "built without EGL";
+#endif
+        if (createGlfw()) { return createFramebuffer(w, h); }
+        error = eglError + ", and " + error;
+        return false;
+    }
+
+    void destroy() {
+        if (framebuffer != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &colorBuffer);
+            glDeleteRenderbuffers(1, &depthBuffer);
+            framebuffer = colorBuffer = depthBuffer = 0;
+        }
+#ifdef HAVE_EGL
+        if (context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+        if (display != EGL_NO_DISPLAY) {
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+        }
+#endif
+        if (window != nullptr) {
+            glfwDestroyWindow(window);
+            window = nullptr;
+        }
+        if (startedGlfw) {
+            glfwTerminate();
+            startedGlfw = false;
+        }
+    }
+
+    // Renderer and version, e.g. llvmpipe (LLVM 15.0.6) 4.5 Core Mesa 22.3.6
+    std::string description() const {
+        return std::string((const char *) glGetString(GL_RENDERER)) + " " + (const char *) glGetString(GL_VERSION);
+    }
+
+    // Reads the framebuffer back and writes it to a PNG file, top row first
+    bool writePng(const std::string &file) {
+        pixels.resize((size_t) width * height * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        const int stride = width * 4;
+        return stbi_write_png(file.c_str(), width, height, 4, pixels.data() + (size_t) stride * (height - 1), -stride) != 0;
+    }
+
+#ifdef HAVE_EGL
+    // Another context sharing objects with this one, for a worker thread to
+    // make current with makeCurrent. EGL_NO_CONTEXT if it can't be created,
+    // as when create fell back to GLFW.
+    EGLContext createShared() {
+        if (context == EGL_NO_CONTEXT) { return EGL_NO_CONTEXT; }
+        return eglCreateContext(display, EGL_NO_CONFIG_KHR, context, attributes);
+    }
+
+    // Makes shared, or no context, current on the calling thread
+    bool makeCurrent(EGLContext shared) {
+        return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, shared) == EGL_TRUE;
+    }
+
+    // Once no thread has shared current any more
+    void destroyShared(EGLContext shared) { eglDestroyContext(display, shared); }
+#endif
+
+private:
+#ifdef HAVE_EGL
+    static constexpr EGLint attributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool createEgl() {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay == nullptr) { return fail("no eglGetPlatformDisplayEXT"); }
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            display = EGL_NO_DISPLAY;
+            return fail("no surfaceless EGL display");
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) { return fail("no desktop OpenGL through EGL"); }
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+        if (context == EGL_NO_CONTEXT) { return fail("could not create an OpenGL 3.3 core context"); }
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) { return fail("could not make it current"); }
+        backend = "EGL surfaceless";
+        return true;
+    }
+#endif
+
+    GLFWwindow *window = nullptr;
+    bool startedGlfw = false;
+    std::vector<unsigned char> pixels; // read back by writePng
+
+    // An invisible window, with an OSMesa context if GLFW can make one
+    bool createGlfw() {
+        if (!glfwInit()) { return fail("GLFW could not start"); }
+        startedGlfw = true;
+        for (int osmesa = 1; osmesa >= 0 && window == nullptr; --osmesa) {
+            glfwDefaultWindowHints();
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            if (osmesa) { glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API); }
+            window = glfwCreateWindow(64, 64, "HW2c - headless", nullptr, nullptr);
+            backend = osmesa ? "GLFW OSMesa" : "GLFW invisible window";
+        }
+        if (window == nullptr) { return fail("GLFW could not make an OSMesa context or an invisible window"); }
+        glfwMakeContextCurrent(window);
+        return true;
+    }
+
+    bool createFramebuffer(int w, int h) {
+        width = w;
+        height = h;
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { return fail("incomplete framebuffer"); }
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    bool fail(const char *why) {
+        error = why;
+        destroy();
+        return false;
+    }
+};
+
+#endif
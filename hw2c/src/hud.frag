@@ -0,0 +1,13 @@
+#version 330 core
+
+// The font atlas, which has a white pixel for the untextured shapes
+uniform sampler2D atlas;
+
+in vec2 vuv;
+in vec4 vcolor;
+
+layout(location=0) out vec4 out_fragcolor;
+
+void main(){
+	out_fragcolor = vcolor * texture(atlas, vuv);
+}
@@ -0,0 +1,290 @@
+#ifndef HUD_HPP
+#define HUD_HPP
+
+#include <cstddef>
+#include <string>
+#include "profiler.hpp"
+#include "shader.hpp"
+#include "shader_variants.hpp"
+
+#define NK_INCLUDE_FIXED_TYPES
+#define NK_INCLUDE_STANDARD_IO
+#define NK_INCLUDE_STANDARD_VARARGS
+#define NK_INCLUDE_DEFAULT_ALLOCATOR
+#define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
+#define NK_INCLUDE_FONT_BAKING
+#define NK_INCLUDE_DEFAULT_FONT
+#define NK_IMPLEMENTATION
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstringop-overflow" // a false positive in nk_memset at -O3
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized" // and in nk_widget_position and nk_do_property
+#endif
+#include "glfw/deps/nuklear.h"
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+//
+//	Overlay with the frame profiler's percentiles, drawn over the scene with
+//	nuklear. The nuklear_glfw_gl2.h backend that comes with GLFW draws with
+//	the fixed function pipeline, which a core profile doesn't have, so the
+//	overlay converts nuklear's commands into its own vertex and index
+//	buffers and draws them with hud.vert and hud.frag. It takes no input.
+//
+
+class ProfilerHud {
+public:
+    bool visible = false;
+    std::string shaderDirectory; // where hud.vert and hud.frag are read from, embedded if empty
+
+    ProfilerHud() = default;
+    ProfilerHud(const ProfilerHud &) = delete;
+    ProfilerHud &operator=(const ProfilerHud &) = delete;
+
+    ~ProfilerHud() { destroy(); }
+
+    // Bakes the font and builds the shader. draw does it the first time, so
+    // an overlay that is never shown costs nothing at startup. The program
+    // and vertex array bound before are bound again after.
+    void init() {
+        GLint program = 0, vertexArray = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+        shader.init_from_strings(preprocessShader("hud.vert", shaderDirectory), preprocessShader("hud.frag", shaderDirectory));
+        shader.enable();
+        glUniform1i(shader.uniform("atlas"), 0);
+        projectionLocation = shader.uniform("projection");
+
+        nk_font_atlas_init_default(&atlas);
+        nk_font_atlas_begin(&atlas);
+        struct nk_font *font = nk_font_atlas_add_default(&atlas, 13, nullptr);
+        int width, height;
+        const void *pixels = nk_font_atlas_bake(&atlas, &width, &height, NK_FONT_ATLAS_RGBA32);
+        glGenTextures(1, &fontTexture);
+        glBindTexture(GL_TEXTURE_2D, fontTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        nk_font_atlas_end(&atlas, nk_handle_id((int) fontTexture), &null);
+        nk_init_default(&context, &font->handle);
+        nk_buffer_init_default(&commands);
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, MAX_VERTEX_BYTES, nullptr, GL_STREAM_DRAW);
+        glGenBuffers(1, &ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, MAX_INDEX_BYTES, nullptr, GL_STREAM_DRAW);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid *) offsetof(Vertex, position));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid *) offsetof(Vertex, uv));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (const GLvoid *) offsetof(Vertex, color));
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(program);
+        initialized = true;
+    }
+
+    void destroy() {
+        if (!initialized) { return; }
+        nk_buffer_free(&commands);
+        nk_free(&context);
+        nk_font_atlas_clear(&atlas);
+        glDeleteTextures(1, &fontTexture);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ibo);
+        glDeleteVertexArrays(1, &vao);
+        initialized = false;
+    }
+
+    // Draws the profiler's percentiles over a width x height framebuffer,
+    // leaving the GL state as it found it. A frame whose overlay can't be
+    // mapped or doesn't fit the buffers goes without it.
+    void draw(const FrameProfiler &profiler, int width, int height) {
+        if (!initialized) { init(); }
+        build(profiler);
+        render(width, height);
+    }
+
+private:
+    static constexpr size_t MAX_VERTEX_BYTES = 256 * 1024;
+    static constexpr size_t MAX_INDEX_BYTES = 64 * 1024;
+
+    struct Vertex {
+        float position[2];
+        float uv[2];
+        nk_byte color[4];
+    };
+
+    mcl::Shader shader;
+    GLint projectionLocation = -1;
+    GLuint fontTexture = 0, vao = 0, vbo = 0, ibo = 0;
+    struct nk_context context;
+    struct nk_font_atlas atlas;
+    struct nk_draw_null_texture null;
+    struct nk_buffer commands;
+    bool initialized = false;
+
+    // One row per phase, its CPU and GPU p50, p95 and p99 in milliseconds
+    void build(const FrameProfiler &profiler) {
+        nk_input_begin(&context);
+        nk_input_end(&context);
+        const float rowHeight = 16;
+        const float height = (profiler.phases().size() + 3) * (rowHeight + 4) + 40;
+        const nk_flags flags = NK_WINDOW_BORDER | NK_WINDOW_TITLE | NK_WINDOW_NO_SCROLLBAR | NK_WINDOW_NO_INPUT;
+        if (nk_begin(&context, "Frame profiler, ms", nk_rect(10, 10, 470, height), flags)) {
+            static const char *header[] = {"phase", "CPU p50", "p95", "p99", "GPU p50", "p95", "p99"};
+            nk_layout_row_dynamic(&context, rowHeight, 7);
+            for (const char *h : header) { nk_label(&context, h, h == header[0] ? NK_TEXT_LEFT : NK_TEXT_RIGHT); }
+            double p50, p95, p99;
+            for (const FrameProfiler::Phase &phase : profiler.phases()) {
+                if (phase.cpu.size() == 0) { continue; } // not run here, like swap in a headless run
+                nk_label(&context, phase.name.c_str(), NK_TEXT_LEFT);
+                phase.cpu.percentiles(p50, p95, p99);
+                labels(p50, p95, p99);
+                if (phase.gpu && phase.gpuTime.size() > 0) {
+                    phase.gpuTime.percentiles(p50, p95, p99);
+                    labels(p50, p95, p99);
+                } else {
+                    for (int i = 0; i < 3; ++i) { nk_label(&context, "-", NK_TEXT_RIGHT); }
+                }
+            }
+            nk_label(&context, "frame", NK_TEXT_LEFT);
+            profiler.frameTimes().percentiles(p50, p95, p99);
+            labels(p50, p95, p99);
+            const double mean = profiler.frameTimes().mean();
+            nk_layout_row_dynamic(&context, rowHeight, 1);
+            nk_labelf(&context, NK_TEXT_LEFT, "%.1f fps mean over the last %zu frames", mean > 0 ? 1000 / mean : 0.0,
+                      profiler.frameTimes().size());
+        }
+        nk_end(&context);
+    }
+
+    void labels(double p50, double p95, double p99) {
+        nk_labelf(&context, NK_TEXT_RIGHT, "%.3f", p50);
+        nk_labelf(&context, NK_TEXT_RIGHT, "%.3f", p95);
+        nk_labelf(&context, NK_TEXT_RIGHT, "%.3f", p99);
+    }
+
+    // The state render changes, to put back as it was
+    struct SavedState {
+        GLint program, vertexArray, arrayBuffer, activeTexture, texture;
+        GLint blendEquationRgb, blendEquationAlpha, blendSrcRgb, blendDstRgb, blendSrcAlpha, blendDstAlpha;
+        GLint scissorBox[4];
+        GLboolean blend, scissorTest, depthTest, cullFace;
+
+        void save() {
+            glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+            glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+            glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+            glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+            glActiveTexture(GL_TEXTURE0);
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+            glGetIntegerv(GL_BLEND_EQUATION_RGB, &blendEquationRgb);
+            glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &blendEquationAlpha);
+            glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrcRgb);
+            glGetIntegerv(GL_BLEND_DST_RGB, &blendDstRgb);
+            glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendSrcAlpha);
+            glGetIntegerv(GL_BLEND_DST_ALPHA, &blendDstAlpha);
+            glGetIntegerv(GL_SCISSOR_BOX, scissorBox);
+            blend = glIsEnabled(GL_BLEND);
+            scissorTest = glIsEnabled(GL_SCISSOR_TEST);
+            depthTest = glIsEnabled(GL_DEPTH_TEST);
+            cullFace = glIsEnabled(GL_CULL_FACE);
+        }
+
+        void restore() const {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glActiveTexture(activeTexture);
+            glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+            glBindVertexArray(vertexArray);
+            glUseProgram(program);
+            glBlendEquationSeparate(blendEquationRgb, blendEquationAlpha);
+            glBlendFuncSeparate(blendSrcRgb, blendDstRgb, blendSrcAlpha, blendDstAlpha);
+            glScissor(scissorBox[0], scissorBox[1], scissorBox[2], scissorBox[3]);
+            enable(GL_BLEND, blend);
+            enable(GL_SCISSOR_TEST, scissorTest);
+            enable(GL_DEPTH_TEST, depthTest);
+            enable(GL_CULL_FACE, cullFace);
+        }
+
+        static void enable(GLenum capability, GLboolean on) {
+            if (on) { glEnable(capability); }
+            else { glDisable(capability); }
+        }
+    };
+
+    void render(int width, int height) {
+        SavedState saved;
+        saved.save();
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_SCISSOR_TEST);
+
+        // Pixels, y down, to clip space
+        const GLfloat projection[16] = {2.f / width, 0, 0, 0, 0, -2.f / height, 0, 0, 0, 0, -1, 0, -1, 1, 0, 1};
+        shader.enable();
+        glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, projection);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+
+        // Nuklear writes the triangles straight into the mapped buffers. If
+        // either can't be mapped, or they fill up, this frame has no overlay.
+        void *vertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, MAX_VERTEX_BYTES, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        void *indices = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, MAX_INDEX_BYTES,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        nk_flags converted = NK_CONVERT_INVALID_PARAM;
+        if (vertices && indices) {
+            static const struct nk_draw_vertex_layout_element layout[] = {
+                {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, offsetof(Vertex, position)},
+                {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, offsetof(Vertex, uv)},
+                {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, offsetof(Vertex, color)},
+                {NK_VERTEX_LAYOUT_END}};
+            struct nk_convert_config config = {};
+            config.vertex_layout = layout;
+            config.vertex_size = sizeof(Vertex);
+            config.vertex_alignment = NK_ALIGNOF(Vertex);
+            config.null = null;
+            config.circle_segment_count = 22;
+            config.curve_segment_count = 22;
+            config.arc_segment_count = 22;
+            config.global_alpha = 1.0f;
+            config.shape_AA = NK_ANTI_ALIASING_ON;
+            config.line_AA = NK_ANTI_ALIASING_ON;
+            struct nk_buffer vertexBuffer, indexBuffer;
+            nk_buffer_init_fixed(&vertexBuffer, vertices, MAX_VERTEX_BYTES);
+            nk_buffer_init_fixed(&indexBuffer, indices, MAX_INDEX_BYTES);
+            converted = nk_convert(&context, &commands, &vertexBuffer, &indexBuffer, &config);
+        }
+        // Unmapping fails if the contents were lost, they are undefined then
+        const bool unmapped = (!vertices || glUnmapBuffer(GL_ARRAY_BUFFER)) && (!indices || glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER));
+
+        if (converted == NK_CONVERT_SUCCESS && unmapped) {
+            const struct nk_draw_command *command;
+            const nk_draw_index *offset = nullptr;
+            nk_draw_foreach(command, &context, &commands) {
+                if (command->elem_count == 0) { continue; }
+                glBindTexture(GL_TEXTURE_2D, (GLuint) command->texture.id);
+                glScissor((GLint) command->clip_rect.x, (GLint) (height - (command->clip_rect.y + command->clip_rect.h)),
+                          (GLint) command->clip_rect.w, (GLint) command->clip_rect.h);
+                glDrawElements(GL_TRIANGLES, (GLsizei) command->elem_count, GL_UNSIGNED_SHORT, offset);
+                offset += command->elem_count;
+            }
+        }
+        nk_clear(&context);
+        nk_buffer_clear(&commands);
+        saved.restore();
+    }
+};
+
+#endif
@@ -0,0 +1,17 @@
+#version 330 core
+
+// Nuklear's triangles for the profiler overlay, in pixels from the top left
+uniform mat4 projection;
+
+layout(location=0) in vec2 position;
+layout(location=1) in vec2 uv;
+layout(location=2) in vec4 color;
+
+out vec2 vuv;
+out vec4 vcolor;
+
+void main(){
+	vuv = uv;
+	vcolor = color;
+	gl_Position = projection * vec4(position, 0.0, 1.0);
+}
@@ -0,0 +1,262 @@
+#ifndef INPUT_LOG_HPP
+#define INPUT_LOG_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//
+//	Input events recorded to a small binary log as the window callbacks get
+//	them, and read back to feed the same callbacks again. Replayed at a fixed
+//	timestep, with simulated time advancing by the step every frame however
+//	long the frame took, a log drives the same camera path on every run, so
+//	frame times can be compared between builds. The file is a header and then
+//	one record per event: its type, the microseconds since the one before as
+//	a varint, and the event's fields, integers as zigzag varints and cursor
+//	positions as floats. A key event takes about 9 bytes, a cursor move 11.
+//
+
+const uint32_t INPUT_LOG_VERSION = 1;
+static const char INPUT_LOG_MAGIC[4] = {'H', 'W', 'I', 'N'};
+
+// Event types
+const uint8_t INPUT_KEY = 1;              // key, scancode, action, mods
+const uint8_t INPUT_CURSOR = 2;           // x, y
+const uint8_t INPUT_MOUSE_BUTTON = 3;     // button, action, mods, and x, y where the cursor was
+const uint8_t INPUT_FRAMEBUFFER_SIZE = 4; // width, height
+
+struct InputEvent {
+    uint8_t type = 0;
+    double time = 0; // seconds after recording started
+    int key = 0, scancode = 0, action = 0, mods = 0, button = 0;
+    int width = 0, height = 0;
+    double x = 0, y = 0;
+};
+
+namespace input_log_detail {
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t) v);
+}
+
+static void putInt(std::vector<uint8_t> &out, int v) {
+    putVarint(out, ((uint32_t) v << 1) ^ (uint32_t) (v >> 31));
+}
+
+static void putFloat(std::vector<uint8_t> &out, double v) {
+    const float f = (float) v;
+    uint8_t bytes[sizeof(float)];
+    std::memcpy(bytes, &f, sizeof(float));
+    out.insert(out.end(), bytes, bytes + sizeof(float));
+}
+
+// Reads from p, false if the record runs past end
+static bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uint8_t b = *p++;
+        v |= (uint64_t) (b & 0x7f) << shift;
+        if (b < 0x80) { return true; }
+    }
+    return false;
+}
+
+static bool getInt(const uint8_t *&p, const uint8_t *end, int &v) {
+    uint64_t u;
+    if (!getVarint(p, end, u)) { return false; }
+    v = (int) ((uint32_t) (u >> 1) ^ (uint32_t) -(int64_t) (u & 1));
+    return true;
+}
+
+static bool getFloat(const uint8_t *&p, const uint8_t *end, double &v) {
+    if (end - p < (ptrdiff_t) sizeof(float)) { return false; }
+    float f;
+    std::memcpy(&f, p, sizeof(float));
+    p += sizeof(float);
+    v = f;
+    return true;
+}
+
+} // end namespace input_log_detail
+
+// Writes events as they happen. Does nothing until open succeeds, so the
+// callbacks can always call it.
+class InputRecorder {
+public:
+    InputRecorder() = default;
+    InputRecorder(const InputRecorder &) = delete;
+    InputRecorder &operator=(const InputRecorder &) = delete;
+
+    ~InputRecorder() { close(); }
+
+    // Creates file and writes the header, events are timed from start
+    bool open(const std::string &file, double start) {
+        close();
+        out = std::fopen(file.c_str(), "wb");
+        if (out == nullptr) { return false; }
+        startTime = start;
+        lastMicroseconds = 0;
+        count = 0;
+        uint8_t header[8];
+        std::memcpy(header, INPUT_LOG_MAGIC, 4);
+        std::memcpy(header + 4, &INPUT_LOG_VERSION, 4);
+        return std::fwrite(header, sizeof(header), 1, out) == 1;
+    }
+
+    bool recording() const { return out != nullptr; }
+
+    size_t size() const { return count; }
+
+    void key(double time, int key, int scancode, int action, int mods) {
+        if (!begin(INPUT_KEY, time)) { return; }
+        input_log_detail::putInt(record, key);
+        input_log_detail::putInt(record, scancode);
+        input_log_detail::putInt(record, action);
+        input_log_detail::putInt(record, mods);
+        end();
+    }
+
+    void cursor(double time, double x, double y) {
+        if (!begin(INPUT_CURSOR, time)) { return; }
+        input_log_detail::putFloat(record, x);
+        input_log_detail::putFloat(record, y);
+        end();
+    }
+
+    void mouseButton(double time, int button, int action, int mods, double x, double y) {
+        if (!begin(INPUT_MOUSE_BUTTON, time)) { return; }
+        input_log_detail::putInt(record, button);
+        input_log_detail::putInt(record, action);
+        input_log_detail::putInt(record, mods);
+        input_log_detail::putFloat(record, x);
+        input_log_detail::putFloat(record, y);
+        end();
+    }
+
+    void framebufferSize(double time, int width, int height) {
+        if (!begin(INPUT_FRAMEBUFFER_SIZE, time)) { return; }
+        input_log_detail::putInt(record, width);
+        input_log_detail::putInt(record, height);
+        end();
+    }
+
+    // Flushes and closes the file, false if any write failed
+    bool close() {
+        if (out == nullptr) { return true; }
+        const bool ok = std::ferror(out) == 0;
+        const bool closed = std::fclose(out) == 0;
+        out = nullptr;
+        return ok && closed;
+    }
+
+private:
+    std::FILE *out = nullptr;
+    double startTime = 0;
+    uint64_t lastMicroseconds = 0;
+    size_t count = 0;
+    std::vector<uint8_t> record;
+
+    bool begin(uint8_t type, double time) {
+        if (out == nullptr) { return false; }
+        // Whole microseconds, so the sum of the deltas is exactly the time and never drifts
+        const double seconds = time - startTime;
+        uint64_t microseconds = seconds > 0 ? (uint64_t) std::llround(seconds * 1e6) : 0;
+        if (microseconds < lastMicroseconds) { microseconds = lastMicroseconds; }
+        record.clear();
+        record.push_back(type);
+        input_log_detail::putVarint(record, microseconds - lastMicroseconds);
+        lastMicroseconds = microseconds;
+        return true;
+    }
+
+    void end() {
+        std::fwrite(record.data(), 1, record.size(), out);
+        ++count;
+    }
+};
+
+// A recorded log, fed back a step at a time
+class InputReplay {
+public:
+    std::vector<InputEvent> events;
+    std::string error; // why load failed
+
+    // Reads all of file. A record cut short, as when the recording app was
+    // killed, ends the log without failing it.
+    bool load(const std::string &file) {
+        using namespace input_log_detail;
+        events.clear();
+        next = 0;
+        std::FILE *in = std::fopen(file.c_str(), "rb");
+        if (in == nullptr) { return fail("could not open " + file); }
+        std::vector<uint8_t> bytes;
+        uint8_t buffer[1 << 16];
+        for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), in)) > 0;) { bytes.insert(bytes.end(), buffer, buffer + n); }
+        std::fclose(in);
+
+        uint32_t version = 0;
+        if (bytes.size() < 8 || std::memcmp(bytes.data(), INPUT_LOG_MAGIC, 4) != 0) { return fail(file + " is not an input log"); }
+        std::memcpy(&version, bytes.data() + 4, 4);
+        if (version != INPUT_LOG_VERSION) { return fail(file + " is version " + std::to_string(version)); }
+
+        const uint8_t *p = bytes.data() + 8, *end = bytes.data() + bytes.size();
+        uint64_t microseconds = 0;
+        while (p < end) {
+            InputEvent e;
+            e.type = *p++;
+            uint64_t delta;
+            if (!getVarint(p, end, delta)) { break; }
+            microseconds += delta;
+            e.time = microseconds * 1e-6;
+            bool ok;
+            if (e.type == INPUT_KEY) {
+                ok = getInt(p, end, e.key) && getInt(p, end, e.scancode) && getInt(p, end, e.action) && getInt(p, end, e.mods);
+            } else if (e.type == INPUT_CURSOR) {
+                ok = getFloat(p, end, e.x) && getFloat(p, end, e.y);
+            } else if (e.type == INPUT_MOUSE_BUTTON) {
+                ok = getInt(p, end, e.button) && getInt(p, end, e.action) && getInt(p, end, e.mods) &&
+                     getFloat(p, end, e.x) && getFloat(p, end, e.y);
+            } else if (e.type == INPUT_FRAMEBUFFER_SIZE) {
+                ok = getInt(p, end, e.width) && getInt(p, end, e.height);
+            } else {
+                return fail(file + " has an event of unknown type " + std::to_string(e.type));
+            }
+            if (!ok) { break; }
+            events.push_back(e);
+        }
+        return true;
+    }
+
+    // Calls handle on each event not fed yet that happened by time
+    template<typename F>
+    void feed(double time, const F &handle) {
+        for (; next < events.size() && events[next].time <= time; ++next) { handle(events[next]); }
+    }
+
+    bool finished() const { return next == events.size(); }
+
+    // Seconds from the start of the recording to its last event
+    double duration() const { return events.empty() ? 0 : events.back().time; }
+
+    // Starts feeding from the first event again
+    void rewind() { next = 0; }
+
+private:
+    size_t next = 0;
+
+    bool fail(const std::string &why) {
+        error = why;
+        events.clear();
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+//
+//	Lights
+//
+struct DirLight {
+	vec3 direction;
+	vec3 intensity;
+};
+
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS 1
+#endif
+
+// The first light is a point light at the eye, these fill in for the others.
+// Directions are in eye space, so they move with the camera.
+const DirLight fill_lights[3] = DirLight[3](
+	DirLight( vec3(-0.5, -1.0, -0.3), vec3(0.35, 0.35, 0.3) ),
+	DirLight( vec3(1.0, 0.2, -0.5), vec3(0.2, 0.2, 0.25) ),
+	DirLight( vec3(0.0, 1.0, 0.5), vec3(0.15, 0.15, 0.15) )
+);
+
+
+//
+//	Diffuse color
+//
+vec3 diffuse(DirLight light, vec3 color, vec3 N){
+
+	vec3 L = -1.f*normalize(light.direction);
+
+	// Material values
+	vec3 mamb = color;
+	vec3 mdiff = color;
+
+	// Color coeffs
+	vec3 ambient = 0.1f * mamb * light.intensity;
+	float diff = max( dot(N, L), 0.f );
+	vec3 diffuse = diff * mdiff * light.intensity;
+
+	return ( ambient + diffuse );
+}
@@ -0,0 +1,152 @@
+#ifndef LOD_HPP
+#define LOD_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "face_partition.hpp"
+#include "parallel.hpp"
+#include "simplify.hpp"
+#include "trimesh.hpp"
+
+//
+//	Level of detail per spatial cluster. The mesh is split into clusters of
+//	nearby triangles and each cluster gets a chain of simplified index buffers,
+//	each about half the size of the one before. Cluster borders are locked by
+//	the simplifier, so neighbouring clusters at different levels don't crack.
+//	Every frame the coarsest level whose error projects to less than a pixel
+//	threshold is picked, with some hysteresis so clusters don't flicker.
+//
+
+struct LodLevel {
+    size_t offset, count; // range in LodMesh::indices
+    float error; // object space error bound
+};
+
+struct LodCluster {
+    float center[3], radius;
+    int firstLevel, numLevels;
+    int current; // level drawn last frame
+};
+
+class LodMesh {
+public:
+    std::vector<LodCluster> clusters;
+    std::vector<LodLevel> levels;
+    std::vector<int> indices;
+
+    // Largest number of triangles in a cluster
+    static const size_t clusterFaces = 8192;
+
+    // Clusters below this many triangles aren't simplified further
+    static const size_t minFaces = 64;
+
+    // Builds the clusters and their level chains, on all cores
+    void build(const MeshView &mesh) {
+        clusters.clear();
+        levels.clear();
+        indices.clear();
+        if (mesh.num_faces == 0) { return; }
+
+        // Split faces into clusters of nearby triangles
+        std::vector<int> order;
+        std::vector<std::pair<size_t, size_t>> ranges;
+        partitionFaces(mesh, clusterFaces, order, ranges);
+
+        // Simplify clusters in parallel, each into its own chain
+        std::vector<std::vector<std::vector<Vec3i>>> chains(ranges.size());
+        std::vector<std::vector<float>> errors(ranges.size());
+        ThreadPool::global().parallelFor(ranges.size(), [&](int c) {
+            std::vector<Vec3i> faces;
+            for (size_t i = ranges[c].first; i < ranges[c].second; ++i) { faces.push_back(mesh.faces[order[i]]); }
+            float error = 0;
+            chains[c].push_back(faces);
+            errors[c].push_back(0);
+            while (chains[c].back().size() > minFaces) {
+                float step;
+                std::vector<Vec3i> coarser = simplifyFaces(mesh.vertices, chains[c].back(), chains[c].back().size() / 2, &step);
+                if (coarser.empty() || coarser.size() > chains[c].back().size() * 9 / 10) { break; } // stuck on locked borders
+                error += step; // levels build on each other, so errors add up
+                chains[c].push_back(coarser);
+                errors[c].push_back(error);
+            }
+        });
+
+        // Concatenate in cluster order
+        for (size_t c = 0; c < ranges.size(); ++c) {
+            LodCluster cluster;
+            bounds(mesh, chains[c][0], cluster);
+            cluster.firstLevel = levels.size();
+            cluster.numLevels = chains[c].size();
+            cluster.current = 0;
+            for (size_t l = 0; l < chains[c].size(); ++l) {
+                levels.push_back(LodLevel{indices.size(), chains[c][l].size() * 3, errors[c][l]});
+                for (const Vec3i &t : chains[c][l]) { indices.insert(indices.end(), {t[0], t[1], t[2]}); }
+            }
+            clusters.push_back(cluster);
+        }
+    }
+
+    // Picks a level for every cluster and returns the number of triangles to draw.
+    // pixelsPerUnit is the projected size of one unit at distance one, and a cluster
+    // only switches to a coarser level once it is below the threshold by a margin.
+    size_t select(const float eye[3], float pixelsPerUnit, float thresholdPixels, float hysteresis = 0.7f) {
+        size_t triangles = 0;
+        for (LodCluster &c : clusters) {
+            float dx = c.center[0] - eye[0], dy = c.center[1] - eye[1], dz = c.center[2] - eye[2];
+            float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz) - c.radius, 1e-3f);
+            auto pixels = [&](int l) { return levels[c.firstLevel + l].error * pixelsPerUnit / distance; };
+
+            if (pixels(c.current) > thresholdPixels) {
+                while (c.current > 0 && pixels(c.current) > thresholdPixels) { --c.current; }
+            } else {
+                while (c.current + 1 < c.numLevels && pixels(c.current + 1) <= thresholdPixels * hysteresis) {
+                    ++c.current;
+                }
+            }
+            triangles += levels[c.firstLevel + c.current].count / 3;
+        }
+        return triangles;
+    }
+
+    const LodLevel &level(const LodCluster &c) const { return levels[c.firstLevel + c.current]; }
+
+    void printDetails() const {
+        size_t full = 0, coarsest = 0;
+        for (const LodCluster &c : clusters) {
+            full += levels[c.firstLevel].count / 3;
+            coarsest += levels[c.firstLevel + c.numLevels - 1].count / 3;
+        }
+        std::cout << "LOD clusters: " << clusters.size() << ", levels: " << levels.size()
+                  << ", triangles: " << full << " -> " << coarsest << " at the coarsest" << std::endl;
+    }
+
+private:
+    static void bounds(const MeshView &mesh, const std::vector<Vec3i> &faces, LodCluster &cluster) {
+        float lo[3] = {HUGE_VALF, HUGE_VALF, HUGE_VALF}, hi[3] = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+        for (const Vec3i &t : faces) {
+            for (int k = 0; k < 3; ++k) {
+                for (int a = 0; a < 3; ++a) {
+                    lo[a] = std::min(lo[a], mesh.vertices[t[k]][a]);
+                    hi[a] = std::max(hi[a], mesh.vertices[t[k]][a]);
+                }
+            }
+        }
+        float r2 = 0;
+        for (int a = 0; a < 3; ++a) { cluster.center[a] = (lo[a] + hi[a]) / 2; }
+        for (const Vec3i &t : faces) {
+            for (int k = 0; k < 3; ++k) {
+                float d2 = 0;
+                for (int a = 0; a < 3; ++a) {
+                    float d = mesh.vertices[t[k]][a] - cluster.center[a];
+                    d2 += d * d;
+                }
+                r2 = std::max(r2, d2);
+            }
+        }
+        cluster.radius = std::sqrt(r2);
+    }
+};
+
+#endif
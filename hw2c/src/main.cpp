@@ -2,28 +2,71 @@
 #include "gl.h"
 #include "gl3.h"
 #include "trimesh.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+#include "lod.hpp"
+#include "meshlet.hpp"
+#include "quantize.hpp"
+#include "vertex_layout.hpp"
+#include "transform_batch.hpp"
 #include "shader.hpp"
+#include "shader_variants.hpp"
 #include "mat4.hpp"
+#include "affine3.hpp"
+#include "camera.hpp"
+#include "frame_uniforms.hpp"
+#include "headless.hpp"
+#include "input_log.hpp"
+#include "profiler.hpp"
+#include "hud.hpp"
+#include "trace.hpp"
 #include "vec3.hpp"
+#include "bench.hpp"
+#include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <memory>
 
 using namespace std;
 
 namespace Globals {
     GLuint vertsVbo[1], colorsVbo[1], normalsVbo[1], facesIbo[1], trisVao;
+
+    // The same attributes in one interleaved buffer, drawn instead if interleaved is set
+    GLuint interleavedVbo[1], interleavedVao = 0;
+    bool interleaved = false;
     TriMesh mesh;
 
-    // Small rotation matrices
-    const Mat4 rotCCW(2, Y);
-    const Mat4 rotCW(-2, Y);
+    // What gets drawn: the arrays of mesh, or of meshCache if it was up to date
+    MeshCache meshCache;
+    MeshView meshView;
+
+    // Per cluster levels of detail, drawn instead of the full mesh if useLod is set
+    LodMesh lod;
+    bool useLod = false;
+    float lodPixels = 1; // largest screen space error allowed
+
+    // Meshlets culled on the CPU every frame, drawn instead of the full mesh if useMeshlets is set
+    MeshletMesh meshlets;
+    bool useMeshlets = false;
+    size_t culledTriangles = 0;
+
+    // Packed vertex attributes, positions are mapped back by the vertex shader
+    bool quantize = false;
+    PositionQuantization positionQuantization;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t indexSize = sizeof(int);
 
-    Mat4 modelMatrix;
+    Affine3 modelMatrix;
 
-    // Default values of eye, view dir and up dir
-    Vec3 eye(0, -12, 0);
-    Vec3 viewDir(1, 0, 0);
-    Vec3 upDir(0, 1, 0);
-    Mat4 viewMatrix;
+    // Default eye, view dir and up dir. The view matrix is built from the camera every frame.
+    Camera camera(Vec3(0, -12, 0), Vec3(1, 0, 0), Vec3(0, 1, 0));
+    Affine3 viewMatrix;
+
+    // Scripted camera path, played from flyStart while flying is set
+    Flythrough flythrough;
+    bool flying = false;
+    double flyStart = 0;
 
     // Deafault window size
     int winWidth = 1000;
@@ -33,58 +76,88 @@ namespace Globals {
     float bottom = -1, top = 1;
 
     Mat4 projectionMatrix;
+
+    // Products of the above for the vertex shader, uploaded only when they change
+    MatrixUniforms matrixUniforms;
+
+    // Shader variant to draw with: the features the mesh needs, and the lights, which L cycles through
+    uint32_t shaderFeatures = 0;
+    int lights = 1;
+
+    // Input written to a log with --record, or fed back from one with --replay
+    InputRecorder recorder;
+    InputReplay replay;
+    bool replaying = false;
+
+    // Time runs a fixed timestep per frame in replays and headless runs, else it is glfwGetTime
+    bool fixedStep = false;
+    double timestep = 1.0 / 60;
+    double stepTime = 0;
+
+    // Where the frame time goes, phase by phase. H shows the percentiles over the scene.
+    FrameProfiler profiler;
+    const int clearPhase = profiler.add("clear"), uploadPhase = profiler.add("upload"), drawPhase = profiler.add("draw"),
+              hudPhase = profiler.add("hud"), swapPhase = profiler.add("swap + events", false);
+    ProfilerHud hud;
 }
 
-//Vec3f transformVector(Mat4 const &mat, Vec3f const &v) {
-//    vector<float> values = mat.getAll();
-//    Vec3f result(values[0] * v[0] + values[1] * v[1] + values[2] * v[2] + values[3] * 0,
-//                 values[4] * v[0] + values[5] * v[1] + values[6] * v[2] + values[7] * 0,
-//                 values[8] * v[0] + values[9] * v[1] + values[10] * v[2] + values[11] * 0);
-//
-//    return result;
-//}
+// Seconds the scene animates by
+static double appTime() { return Globals::fixedStep ? Globals::stepTime : glfwGetTime(); }
 
 static void errorCallback(int error, const char *description) {
     cerr << "Error: " << description << endl;
 }
 
-void setViewMatrix(Vec3 eye, Vec3 viewDir, Vec3 upDir) {
-    Vec3 n = viewDir.unit() * -1;
-    Vec3 u = upDir.unit().cross(n);
-    Vec3 v = n.cross(u);
-    Vec3 d(-eye.dot(u), -eye.dot(v), -eye.dot(n));
-    Globals::viewMatrix.setAsViewMatrix(u, v, n, d);
-}
-
-static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+// What a key does, from the window or a replay. window is null in headless runs.
+static void applyKey(GLFWwindow *window, int key, int scancode, int action, int mods) {
     using namespace Globals;
     switch (key) {
         case GLFW_KEY_ESCAPE:
-            glfwSetWindowShouldClose(window, GL_TRUE);
+            if (window) { glfwSetWindowShouldClose(window, GL_TRUE); }
             break;
         case GLFW_KEY_Q:
-            glfwSetWindowShouldClose(window, GL_TRUE);
+            if (window) { glfwSetWindowShouldClose(window, GL_TRUE); }
             break;
         case GLFW_KEY_UP:
-            eye = eye + viewDir.unit() * 0.05;
-            setViewMatrix(eye, viewDir, upDir);
+            camera.moveForward(0.05);
             break;
         case GLFW_KEY_DOWN:
-            eye = eye + viewDir.unit() * -0.05;
-            setViewMatrix(eye, viewDir, upDir);
+            camera.moveForward(-0.05);
             break;
         case GLFW_KEY_LEFT:
-            viewDir = rotCCW.transformVector(viewDir);
-            setViewMatrix(eye, viewDir, upDir);
+            camera.yaw(2);
             break;
         case GLFW_KEY_RIGHT:
-            viewDir = rotCW.transformVector(viewDir);
-            setViewMatrix(eye, viewDir, upDir);
+            camera.yaw(-2);
+            break;
+        case GLFW_KEY_PAGE_UP:
+            camera.pitch(2);
+            break;
+        case GLFW_KEY_PAGE_DOWN:
+            camera.pitch(-2);
+            break;
+        case GLFW_KEY_K:
+            if (action == GLFW_PRESS) { cout << camera.poseLine() << endl; } // a line for a flythrough file
+            break;
+        case GLFW_KEY_F:
+            if (action == GLFW_PRESS && !flythrough.keys.empty()) {
+                flying = !flying;
+                flyStart = appTime();
+            }
+            break;
+        case GLFW_KEY_I:
+            if (action == GLFW_PRESS && interleavedVao != 0) { interleaved = !interleaved; }
+            break;
+        case GLFW_KEY_L:
+            if (action == GLFW_PRESS) { lights = lights % SHADER_MAX_LIGHTS + 1; }
+            break;
+        case GLFW_KEY_H:
+            if (action == GLFW_PRESS) { hud.visible = !hud.visible; }
             break;
     }
 }
 
-static void framebufferSizeCallback(GLFWwindow *window, int newWidth, int newHeight) {
+static void applyFramebufferSize(int newWidth, int newHeight) {
     using namespace Globals;
 
     Globals::left *= ((float) newWidth) / winWidth;
@@ -99,36 +172,388 @@ static void framebufferSizeCallback(GLFWwindow *window, int newWidth, int newHei
     glViewport(0, 0, newWidth, newHeight);
 }
 
+// While a log is replayed the person at the keyboard can only quit
+static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    if (Globals::replaying && key != GLFW_KEY_ESCAPE && key != GLFW_KEY_Q) { return; }
+    Globals::recorder.key(glfwGetTime(), key, scancode, action, mods);
+    applyKey(window, key, scancode, action, mods);
+}
+
+static void framebufferSizeCallback(GLFWwindow *window, int newWidth, int newHeight) {
+    if (Globals::replaying) { return; }
+    Globals::recorder.framebufferSize(glfwGetTime(), newWidth, newHeight);
+    applyFramebufferSize(newWidth, newHeight);
+}
+
+// Does what a replayed event did when it was recorded. Headless runs keep
+// the size they were given, and the cursor moves nothing here.
+static void applyInputEvent(GLFWwindow *window, const InputEvent &e) {
+    if (e.type == INPUT_KEY) { applyKey(window, e.key, e.scancode, e.action, e.mods); }
+    else if (e.type == INPUT_FRAMEBUFFER_SIZE && window) { applyFramebufferSize(e.width, e.height); }
+}
+
+// Moves and scales the vertices of mesh so its bounding box is centered at the
+// origin and fits in (-1,1). Uniform scaling leaves the normals as they are.
+void fitMesh(TriMesh &mesh) {
+    if (mesh.vertices.empty()) { return; }
+    float lo[3], hi[3];
+    boundingBox(mesh.vertices[0].data, mesh.vertices.size(), lo, hi);
+    float extent = max(hi[0] - lo[0], max(hi[1] - lo[1], hi[2] - lo[2]));
+    if (!(extent > 0)) { return; }
+    Mat4 fit = Mat4(2 / extent, 2 / extent, 2 / extent) *
+               Mat4(Vec3(-(lo[0] + hi[0]) / 2, -(lo[1] + hi[1]) / 2, -(lo[2] + hi[2]) / 2));
+    parallelTransformPoints(fit, mesh.vertices[0].data, mesh.vertices[0].data, mesh.vertices.size());
+}
+
+// Sets Globals::meshView to the mesh in objFile. An up to date binary cache is mapped and
+// used as is, otherwise the OBJ is parsed into Globals::mesh and the cache (re)written.
+// With optimize set, the mesh is reordered for the vertex cache after loading, and with fit
+// set it is scaled into (-1,1) by fitMesh.
+bool loadMesh(const std::string &objFile, bool useCache, bool optimize, bool fit) {
+    using namespace Globals;
+    TRACE_SCOPE("loadMesh");
+    double start = bench::now();
+    const uint32_t flags = MESH_CACHE_DEDUPLICATED | (optimize ? MESH_CACHE_VERTEX_CACHE_OPTIMIZED : 0) |
+                           (fit ? MESH_CACHE_FITTED : 0);
+
+    uint64_t hash = 0, size = 0;
+    const std::string cacheFile = meshCacheFile(MY_CACHE_DIR, objFile, flags);
+    if (useCache && !hashFile(objFile, &hash, &size)) {
+        cerr << "\n**Error: Could not open file " << objFile << endl;
+        return false;
+    }
+
+    if (useCache && meshCache.open(cacheFile, flags, hash, size)) {
+        meshView = meshCache.view();
+        cout << "\nLoaded " << cacheFile << endl;
+        cout << "Vertices: " << meshView.num_vertices << endl;
+        cout << "Faces: " << meshView.num_faces << endl;
+    } else {
+        if (!mesh.load_obj(objFile, 0, true)) { return false; }
+        mesh.print_details();
+        if (optimize) {
+            TRACE_SCOPE("optimizeMesh");
+            optimizeMesh(mesh);
+        }
+        if (fit) { fitMesh(mesh); }
+        meshView = mesh.view();
+        if (useCache) {
+            TRACE_SCOPE("writeMeshCache");
+            if (!writeMeshCache(cacheFile, mesh, flags, hash, size)) {
+                cerr << "**Warning: Could not write mesh cache " << cacheFile << endl;
+            }
+        }
+    }
+
+    cout << "Mesh ready in " << (bench::now() - start) * 1000 << " ms" << endl;
+    return true;
+}
+
+// Draws every LOD cluster at the level its screen space error calls for,
+// returns the number of triangles drawn
+size_t drawLod() {
+    using namespace Globals;
+    // Something one unit across at distance one covers projection(1,1) * winHeight / 2 pixels
+    float pixelsPerUnit = projectionMatrix.get(1, 1) * winHeight / 2;
+    Vec3 eye = camera.eye();
+    float eyePosition[3] = {eye.x, eye.y, eye.z};
+    size_t triangles = lod.select(eyePosition, pixelsPerUnit, lodPixels);
+    for (const LodCluster &cluster : lod.clusters) {
+        const LodLevel &level = lod.level(cluster);
+        glDrawElements(GL_TRIANGLES, level.count, indexType, (const GLvoid *) (level.offset * indexSize));
+    }
+    return triangles;
+}
+
+// Culls meshlets against the view frustum and their normal cones and draws the
+// index ranges left, returns the number of triangles drawn
+size_t drawMeshlets() {
+    using namespace Globals;
+    const Mat4 clip = projectionMatrix * (viewMatrix * modelMatrix).toMat4();
+    Vec3 eye = camera.eye();
+    float eyePosition[3] = {eye.x, eye.y, eye.z}; // model space too, as modelMatrix is the identity
+    culledTriangles = meshlets.cull(clip.data(), eyePosition);
+    for (const auto &range : meshlets.visible) {
+        glDrawElements(GL_TRIANGLES, range.second, indexType, (const GLvoid *) (range.first * indexSize));
+    }
+    return meshlets.indices.size() / 3 - culledTriangles;
+}
+
 void initScene();
 
+static_assert(hasEmbeddedShader("shader.vert") && hasEmbeddedShader("shader.frag"),
+              "shader.vert and shader.frag have to be embedded, see SHADERS in CMakeLists.txt");
+
+// Shader variant bits the mesh needs: vertex colors only if they aren't all the
+// same, and two-sided lighting unless back faces are culled anyway
+static uint32_t sceneShaderFeatures() {
+    using namespace Globals;
+    uint32_t features = useMeshlets ? 0 : SHADER_TWO_SIDED;
+    for (size_t i = 1; i < meshView.num_colors; ++i) {
+        if (memcmp(&meshView.colors[i], &meshView.colors[0], sizeof(Vec3f)) != 0) {
+            features |= SHADER_VERTEX_COLORS;
+            break;
+        }
+    }
+    return features;
+}
+
+// Starts building the shader variants the scene needs, one per light count
+// with the one drawn first first, on workers if any are given. Their sources
+// are compiled into the binary, see EMBEDDED_SHADERS in CMakeLists.txt, unless
+// shaderDirectory names a directory to read them from. Linked programs are
+// cached as binaries next to the mesh caches.
+static void setupShaders(ShaderVariants &shaders, const std::string &shaderDirectory, bool useCache,
+                         const std::vector<mcl::ShaderWorker *> &workers) {
+    using namespace Globals;
+    TRACE_SCOPE("setupShaders");
+    shaders.init("shader.vert", "shader.frag", shaderDirectory, useCache ? std::string(MY_CACHE_DIR) + "shaders" : "");
+    shaders.setWorkers(workers);
+    const Vec3f baseColor = meshView.num_colors > 0 ? meshView.colors[0] : Vec3f(0.3f, 0.3f, 0.3f);
+    shaders.onReady = [baseColor](mcl::Shader &shader) {
+        shader.uniform_block("Frame", FRAME_BLOCK_BINDING);
+        const int baseColorHandle = shader.uniform_handle("base_color");
+        if (baseColorHandle >= 0) { glUniform3f(shader.uniform(baseColorHandle), baseColor[0], baseColor[1], baseColor[2]); }
+    };
+    shaderFeatures = sceneShaderFeatures();
+    std::vector<uint32_t> variants(1, shaderVariant(shaderFeatures, lights));
+    for (int l = 1; l <= SHADER_MAX_LIGHTS; ++l) {
+        if (l != lights) { variants.push_back(shaderVariant(shaderFeatures, l)); }
+    }
+    shaders.precompile(variants);
+}
+
+// Depth test, culling and clear color, once the context is current
+static void initGlState() {
+    glEnable(GL_DEPTH_TEST);
+    if (Globals::useMeshlets) { glEnable(GL_CULL_FACE); } // what cone culling does per meshlet, done per triangle
+    glClearColor(1.f, 1.f, 1.f, 1.f);
+}
+
+// Maps quantized positions back, through the matrices the vertex shader gets
+static Affine3 dequantizeMatrix() {
+    const PositionQuantization &q = Globals::positionQuantization;
+    return Affine3::translation(Vec3(q.offset[0], q.offset[1], q.offset[2])) * Affine3::scale(q.scale[0], q.scale[1], q.scale[2]);
+}
+
+// Draws the scene with variant from the camera where it is, after the frame
+// is cleared. Returns the number of triangles drawn.
+static size_t drawScene(ShaderVariants &shaders, uint32_t variant, UniformRing<FrameBlock> &frameUniforms,
+                        const Affine3 &dequantize) {
+    using namespace Globals;
+    shaders.use(variant);
+
+    // Build the view matrix once for the frame, and send updated info to
+    // the GPU, only if the camera, model or window changed
+    {
+        ProfileScope upload(profiler, uploadPhase);
+        viewMatrix = camera.viewMatrix();
+        if (matrixUniforms.update(projectionMatrix, viewMatrix, modelMatrix, dequantize)) {
+            frameUniforms.map()->set(modelMatrix, viewMatrix, projectionMatrix, matrixUniforms, camera);
+            frameUniforms.publish();
+        }
+    }
+
+    // Draw, from whichever vertex layout is selected
+    ProfileScope draw(profiler, drawPhase);
+    glBindVertexArray(interleaved ? interleavedVao : trisVao);
+    if (useLod) { return drawLod(); }
+    if (useMeshlets) { return drawMeshlets(); }
+    glDrawElements(GL_TRIANGLES, meshView.num_faces * 3, indexType, 0);
+    return meshView.num_faces;
+}
+
+// Renders frames frames of the scene at width x height into a framebuffer,
+// with no window, and writes each to outputDirectory as frame_00000.png and
+// on if it isn't empty. Time advances Globals::timestep a frame, for the
+// flythrough and the replay if any, which then runs to its last event however
+// many frames that takes. Prints the time each frame took to draw, which
+// makes it the frame time benchmark too, and with no GPU it runs on llvmpipe.
+static int runHeadless(int width, int height, int frames, const std::string &outputDirectory,
+                       const std::string &shaderDirectory, bool useCache) {
+    using namespace Globals;
+    HeadlessContext context;
+    if (!context.create(width, height)) {
+        cerr << "\n**Error: No headless OpenGL context: " << context.error << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "Headless through " << context.backend << ", " << context.description() << ", " << width << "x" << height
+         << endl;
+    if (!outputDirectory.empty()) { std::filesystem::create_directories(outputDirectory); }
+
+    // Everything is built before the first frame, there is nothing to show meanwhile
+    double start = bench::now();
+    ShaderVariants shaders;
+    setupShaders(shaders, shaderDirectory, useCache, {});
+    initScene();
+    applyFramebufferSize(width, height);
+    initGlState();
+    profiler.init();
+    hud.shaderDirectory = shaderDirectory;
+    UniformRing<FrameBlock> frameUniforms;
+    frameUniforms.init(FRAME_BLOCK_BINDING);
+    const Affine3 dequantize = dequantizeMatrix();
+    fixedStep = true;
+    if (replaying) { frames = (int) (replay.duration() / timestep) + 1; }
+
+    std::vector<double> drawSeconds;
+    double writeSeconds = 0;
+    size_t triangles = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        stepTime = frame * timestep;
+        if (replaying) { replay.feed(stepTime, [](const InputEvent &e) { applyInputEvent(nullptr, e); }); }
+        if (flying) { camera.pose = flythrough.at(stepTime - flyStart); }
+        const uint32_t variant = shaderVariant(shaderFeatures, lights);
+
+        // Drawing is timed to the end of the GPU's work, the first frame waits for the shaders
+        const double frameStart = bench::now();
+        profiler.beginFrame();
+        {
+            ProfileScope clear(profiler, clearPhase);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        triangles = drawScene(shaders, variant, frameUniforms, dequantize);
+        if (hud.visible) {
+            ProfileScope overlay(profiler, hudPhase);
+            hud.draw(profiler, winWidth, winHeight);
+            shaders.invalidate();
+        }
+        {
+            TRACE_SCOPE("glFinish");
+            glFinish();
+        }
+        profiler.endFrame();
+        const double frameEnd = bench::now();
+        if (frame == 0) {
+            cout << "First frame in " << (frameEnd - start) * 1000 << " ms, " << shaderVariantName(variant)
+                 << (shaders.fromBinaryCache(variant) ? " from the binary cache" : " compiled") << endl;
+        } else {
+            drawSeconds.push_back(frameEnd - frameStart);
+        }
+
+        if (!outputDirectory.empty()) {
+            char name[32];
+            snprintf(name, sizeof(name), "frame_%05d.png", frame);
+            const std::string file = (std::filesystem::path(outputDirectory) / name).string();
+            TRACE_SCOPE("writePng");
+            if (!context.writePng(file)) {
+                cerr << "\n**Error: Could not write " << file << endl;
+                return EXIT_FAILURE;
+            }
+            writeSeconds += bench::now() - frameEnd;
+        }
+    }
+
+    bench::printFrameTimes(drawSeconds, triangles);
+    profiler.print();
+    if (!outputDirectory.empty()) {
+        cout << "Wrote " << frames << " frames to " << outputDirectory << ", " << writeSeconds * 1000 / max(frames, 1)
+             << " ms per frame to read back and save" << endl;
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
+    // Command line: [file.obj] [--no-cache] [--optimize] [--lod] [--lod-pixels n] [--quantize] [--interleaved] [--meshlets] [--fit] [--flythrough file] [--lights n] [--shader-dir dir] [--headless WxH] [--frames n] [--output dir] [--record file] [--replay file] [--timestep s] [--trace file.json]
+    std::string objFile = std::string(MY_DATA_DIR) + "sibenik/sibenik.obj";
+    std::string shaderDirectory; // empty for the shaders embedded at build time
+    std::string outputDirectory; // where headless frames are written, none if empty
+    std::string recordFile; // input log to write, none if empty
+    bool useCache = true, optimize = false, fit = false;
+    int headlessWidth = 0, headlessHeight = 0, headlessFrames = 100; // a window unless --headless gives a size
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--no-cache") == 0) { useCache = false; }
+        else if (strcmp(argv[i], "--optimize") == 0) { optimize = true; }
+        else if (strcmp(argv[i], "--lod") == 0) { Globals::useLod = true; }
+        else if (strcmp(argv[i], "--lod-pixels") == 0 && i + 1 < argc) { Globals::lodPixels = atof(argv[++i]); }
+        else if (strcmp(argv[i], "--quantize") == 0) { Globals::quantize = true; }
+        else if (strcmp(argv[i], "--interleaved") == 0) { Globals::interleaved = true; }
+        else if (strcmp(argv[i], "--meshlets") == 0) { Globals::useMeshlets = true; }
+        else if (strcmp(argv[i], "--fit") == 0) { fit = true; }
+        else if (strcmp(argv[i], "--shader-dir") == 0 && i + 1 < argc) { shaderDirectory = argv[++i]; }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) { headlessFrames = max(1, atoi(argv[++i])); }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) { outputDirectory = argv[++i]; }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) { recordFile = argv[++i]; }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (!trace::start(argv[++i])) { cerr << "**Warning: --trace is ignored, built without the TRACE option" << endl; }
+            TRACE_THREAD_NAME("main");
+        }
+        else if (strcmp(argv[i], "--timestep") == 0 && i + 1 < argc) { Globals::timestep = max(1e-4, atof(argv[++i])); }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if (!Globals::replay.load(argv[++i])) {
+                cerr << "\n**Error: Could not replay input: " << Globals::replay.error << endl;
+                return EXIT_FAILURE;
+            }
+            Globals::replaying = true;
+        }
+        else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &headlessWidth, &headlessHeight) != 2 || headlessWidth <= 0 ||
+                headlessHeight <= 0) {
+                cerr << "\n**Error: --headless takes a size like 1280x720, not " << argv[i] << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+            Globals::lights = max(1, min(SHADER_MAX_LIGHTS, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--flythrough") == 0 && i + 1 < argc) {
+            if (!Globals::flythrough.load(argv[++i])) {
+                cerr << "\n**Error: Could not read flythrough " << argv[i] << endl;
+                return EXIT_FAILURE;
+            }
+            Globals::flying = true;
+        }
+        else { objFile = argv[i]; }
+    }
+
     // Load the mesh
-    std::stringstream objFile;
-    objFile << MY_DATA_DIR << "sibenik/sibenik.obj";
-    if (!Globals::mesh.load_obj(objFile.str())) { return 0; }
-    Globals::mesh.print_details();
-
-    // Scale to fit in (-1,1): a temporary measure to allow the entire model to be visible
-    // Should be replaced by the use of an appropriate projection matrix
-    // Original model dimensions: center = (0,0,0); height: 30.6; length: 40.3; width: 17.0
-//    float min = Globals::mesh.vertices[0][0];
-//    float max = Globals::mesh.vertices[0][0];
-//    for (auto &vertex : Globals::mesh.vertices) {
-//        if (vertex[0] < min) { min = vertex[0]; }
-//        else if (vertex[0] > max) { max = vertex[0]; }
-//        if (vertex[1] < min) { min = vertex[1]; }
-//        else if (vertex[1] > max) { max = vertex[1]; }
-//        if (vertex[2] < min) { min = vertex[2]; }
-//        else if (vertex[2] > max) { max = vertex[2]; }
-//    }
-//    float scale;
-//    if (min < 0) { min = -min; }
-//    if (max > min) { scale = 1 / max; }
-//    else { scale = 1 / min; }
-//    Mat4 mScale(scale, scale, scale);
-//    for (auto &vert : Globals::mesh.vertices) {
-//        vert = transformVector(mScale, vert);
-//    }
+    if (!loadMesh(objFile, useCache, optimize, fit)) { return 0; }
+
+    // Simplify it
+    if (Globals::useLod) {
+        double start = bench::now();
+        Globals::lod.build(Globals::meshView);
+        Globals::lod.printDetails();
+        cout << "LOD built in " << (bench::now() - start) * 1000 << " ms" << endl;
+    }
+
+    // Or cut it into meshlets
+    if (Globals::useMeshlets && Globals::useLod) {
+        cerr << "**Warning: --meshlets is ignored with --lod" << endl;
+        Globals::useMeshlets = false;
+    }
+    if (Globals::useMeshlets) {
+        double start = bench::now();
+        Globals::meshlets.build(Globals::meshView);
+        Globals::meshlets.printDetails();
+        cout << "Meshlets built in " << (bench::now() - start) * 1000 << " ms" << endl;
+    }
+
+    // Pack it
+    if (Globals::quantize) {
+        Globals::positionQuantization = PositionQuantization::fit(Globals::meshView.vertices, Globals::meshView.num_vertices);
+        size_t numIndices = Globals::useLod ? Globals::lod.indices.size() :
+                            Globals::useMeshlets ? Globals::meshlets.indices.size() : Globals::meshView.num_faces * 3;
+        printQuantizationDetails(Globals::meshView, Globals::positionQuantization, numIndices);
+    }
+
+    // A replay is the only input a run can record
+    if (!recordFile.empty() && (Globals::replaying || headlessWidth > 0)) {
+        cerr << "**Warning: --record is ignored with --replay and --headless" << endl;
+        recordFile.clear();
+    }
+    if (Globals::replaying) {
+        cout << "Replaying " << Globals::replay.events.size() << " input events, " << Globals::replay.duration()
+             << " s at a " << Globals::timestep * 1000 << " ms timestep" << endl;
+    }
+
+    // Render offscreen instead of opening a window
+    if (headlessWidth > 0) {
+        return runHeadless(headlessWidth, headlessHeight, headlessFrames, outputDirectory, shaderDirectory, useCache);
+    }
 
     // Set up window
     GLFWwindow *window;
@@ -137,9 +562,9 @@ int main(int argc, char *argv[]) {
     // Initialize the window
     if (!glfwInit()) { return EXIT_FAILURE; }
 
-    // Ask for OpenGL 3.2
+    // Ask for OpenGL 3.3, for the profiler's timer queries
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
@@ -156,7 +581,8 @@ int main(int argc, char *argv[]) {
 
     // Make current
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(1);
+    glfwSwapInterval(Globals::replaying ? 0 : 1); // a replay runs as fast as it can, its frame times are what it measures
+    Globals::fixedStep = Globals::replaying;
 
     // Initialize glew AFTER the context creation and before loading the shader.
     // Note we need to use experimental because we're using a modern version of opengl.
@@ -165,63 +591,164 @@ int main(int argc, char *argv[]) {
     glewInit();
 #endif
 
-    // Initialize the shader (which uses glew, so we need to init that first).
-    // MY_SRC_DIR is a define that was set in CMakeLists.txt which gives
-    // the full path to this project's src/ directory.
-    mcl::Shader shader;
-    std::stringstream ss;
-    ss << MY_SRC_DIR << "shader.";
-    shader.init_from_files(ss.str() + "vert", ss.str() + "frag");
+    // Initialize the shaders (which use glew, so we need to init that first).
+    // The variants the mesh needs, one per light count, build in the background
+    // while the scene is uploaded: by the driver if it compiles in parallel, else
+    // on workers with hidden windows sharing this context. The loop draws
+    // placeholder frames until the first one is done.
+    double startupStart = bench::now();
+    std::vector<std::unique_ptr<mcl::ShaderWorker>> shaderWorkers;
+    std::vector<GLFWwindow *> workerWindows;
+    std::vector<mcl::ShaderWorker *> workers;
+    if (!mcl::Shader::parallel_compile_supported()) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        for (int w = 0; w < SHADER_MAX_LIGHTS; ++w) {
+            GLFWwindow *workerWindow = glfwCreateWindow(1, 1, "HW2c - shader worker", NULL, window);
+            if (!workerWindow) { break; }
+            workerWindows.push_back(workerWindow);
+            shaderWorkers.emplace_back(new mcl::ShaderWorker());
+            shaderWorkers.back()->start([workerWindow] { glfwMakeContextCurrent(workerWindow); },
+                                        [] { glfwMakeContextCurrent(NULL); });
+            workers.push_back(shaderWorkers.back().get());
+        }
+    }
+    ShaderVariants shaders;
+    setupShaders(shaders, shaderDirectory, useCache, workers);
 
     // Initialize the scene
     // IMPORTANT: Only call after gl context has been created
     initScene();
-    framebufferSizeCallback(window, Globals::winWidth, Globals::winHeight);
+    applyFramebufferSize(Globals::winWidth, Globals::winHeight);
 
     // Initialize OpenGL
-    glEnable(GL_DEPTH_TEST);
-    glClearColor(1.f, 1.f, 1.f, 1.f);
+    initGlState();
+    Globals::profiler.init();
+    Globals::hud.shaderDirectory = shaderDirectory;
 
-    // Enable the shader, this allows us to set uniforms and attributes
-    shader.enable();
+    // Per frame matrices and camera, one block that any program declaring Frame can read
+    UniformRing<FrameBlock> frameUniforms;
+    frameUniforms.init(FRAME_BLOCK_BINDING);
 
-    // Bind buffers
-    glBindVertexArray(Globals::trisVao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Globals::facesIbo[0]);
+    // Quantized positions are mapped back by the matrices the vertex shader gets
+    const Affine3 dequantize = dequantizeMatrix();
 
     // Game loop
+    double lastTitle = glfwGetTime();
+    int frames = 0;
+    bool shaderReady = false;
+    uint32_t drawnVariant = 0;
+    int replayFrames = 0;
+    double lastSwap = 0;
+    std::vector<double> replaySeconds;
+    size_t triangles = 0;
     while (!glfwWindowShouldClose(window)) {
 
-        // Clear screen
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Send updated info to the GPU
-        float model[16];
-        float view[16];
-        float projection[16];
-        Globals::modelMatrix.dumpColumnWise(model);
-        Globals::viewMatrix.dumpColumnWise(view);
-        Globals::projectionMatrix.dumpColumnWise(projection);
-        glUniformMatrix4fv(shader.uniform("model"), 1, GL_FALSE, model); // model transformation
-        glUniformMatrix4fv(shader.uniform("view"), 1, GL_FALSE, view); // viewing transformation
-        glUniformMatrix4fv(shader.uniform("projection"), 1, GL_FALSE, projection); // projection matrix
-        glUniform3f(shader.uniform("eye"), 0, 0, 0); // used in fragment shader
-
-        // Draw
-        glDrawElements(GL_TRIANGLES, Globals::mesh.faces.size() * 3, GL_UNSIGNED_INT, 0);
+        // Clear screen, profiling from the first frame that draws the scene
+        if (shaderReady) {
+            Globals::profiler.beginFrame();
+            ProfileScope clear(Globals::profiler, Globals::clearPhase);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        } else {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
+        // Until the shaders are built the cleared frame is the placeholder,
+        // the window keeps taking events meanwhile
+        uint32_t variant = shaderVariant(Globals::shaderFeatures, Globals::lights);
+        if (!shaderReady) {
+            if (frames++ == 0) {
+                cout << "First frame in " << (bench::now() - startupStart) * 1000 << " ms" << endl;
+                glfwSetWindowTitle(window, "HW2c - OpenGL - compiling shaders");
+            }
+            if (!shaders.ready(variant)) {
+                TRACE_SCOPE("placeholder frame");
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+                continue;
+            }
+            cout << "Shaders ready in " << (bench::now() - startupStart) * 1000 << " ms, "
+                 << shaderVariantName(variant) << (shaders.fromBinaryCache(variant) ? ", from the binary cache" : ", compiled")
+                 << endl;
+            shaderReady = true;
+            drawnVariant = variant;
+            frames = 0;
+            lastTitle = glfwGetTime();
+
+            // Recording starts with the first frame drawn, as a replay does
+            if (!recordFile.empty() && !Globals::recorder.open(recordFile, glfwGetTime())) {
+                cerr << "**Warning: Could not write input log " << recordFile << endl;
+            }
+        }
+
+        // A replay feeds in the events recorded up to this frame's time, which advances a fixed step per frame
+        if (Globals::replaying) {
+            Globals::stepTime = replayFrames++ * Globals::timestep;
+            Globals::replay.feed(Globals::stepTime, [window](const InputEvent &e) { applyInputEvent(window, e); });
+            variant = shaderVariant(Globals::shaderFeatures, Globals::lights);
+        }
+
+        // Switch to the variant asked for once it is built, keep drawing with the last one until then.
+        // A replay waits for it, so every run switches on the same frame.
+        if (variant != drawnVariant && (Globals::replaying || shaders.ready(variant))) {
+            drawnVariant = variant;
+            cout << "Drawing with " << shaderVariantName(variant) << endl;
+        }
+
+        // Move the camera along the flythrough, then draw
+        if (Globals::flying) { Globals::camera.pose = Globals::flythrough.at(appTime() - Globals::flyStart); }
+        triangles = drawScene(shaders, drawnVariant, frameUniforms, dequantize);
+
+        // The profiler overlay, H toggles it
+        if (Globals::hud.visible) {
+            ProfileScope overlay(Globals::profiler, Globals::hudPhase);
+            Globals::hud.draw(Globals::profiler, Globals::winWidth, Globals::winHeight);
+            shaders.invalidate();
+        }
+
+        // Show the layout, frame time and triangles drawn once per second
+        ++frames;
+        if (glfwGetTime() - lastTitle > 1) {
+            double ms = (glfwGetTime() - lastTitle) * 1000 / frames;
+            lastTitle = glfwGetTime();
+            frames = 0;
+            std::string title = std::string("HW2c - OpenGL - ") + (Globals::interleaved ? "interleaved" : "split") +
+                                " - " + to_string(ms) + " ms - " + to_string(triangles) + " triangles" +
+                                (Globals::useMeshlets ? ", " + to_string(Globals::culledTriangles) + " culled" : "");
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         // Finalize
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            ProfileScope swap(Globals::profiler, Globals::swapPhase);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        Globals::profiler.endFrame();
+
+        // Time a replay from swap to swap, and stop it after its last event
+        if (Globals::replaying) {
+            const double swap = bench::now();
+            if (lastSwap > 0) { replaySeconds.push_back(swap - lastSwap); }
+            lastSwap = swap;
+            if (Globals::replay.finished()) { glfwSetWindowShouldClose(window, GL_TRUE); }
+        }
 
     } // end game loop
 
+    if (Globals::replaying) { bench::printFrameTimes(replaySeconds, triangles); }
+    if (Globals::recorder.recording()) {
+        const size_t events = Globals::recorder.size();
+        if (Globals::recorder.close()) { cout << "Recorded " << events << " input events to " << recordFile << endl; }
+        else { cerr << "**Warning: Could not write input log " << recordFile << endl; }
+    }
+
     // Unbind
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
     // Disable the shader, we're done using it
-    shader.disable();
+    glUseProgram(0);
+    for (auto &worker : shaderWorkers) { worker->stop(); }
+    for (GLFWwindow *workerWindow : workerWindows) { glfwDestroyWindow(workerWindow); }
 
     return EXIT_SUCCESS;
 }
@@ -230,59 +757,139 @@ int main(int argc, char *argv[]) {
 void initScene() {
 
     using namespace Globals;
-
+    TRACE_SCOPE("initScene");
+
+    // Packed copies of the attribute streams, or the float arrays as they are
+    PackedVertices packed;
+    const void *positions = meshView.vertices, *colors = meshView.colors, *normals = meshView.normals;
+    size_t positionBytes = sizeof(Vec3f), attributeBytes = sizeof(Vec3f);
+    if (quantize) {
+        TRACE_SCOPE("packVertices");
+        packVertices(meshView, positionQuantization, packed);
+        positions = packed.positions.data();
+        colors = packed.colors.data();
+        normals = packed.normals.data();
+        positionBytes = PackedVertices::positionStride;
+        attributeBytes = sizeof(uint32_t);
+    }
 
     // Create the buffer for vertices
-    glGenBuffers(1, vertsVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vertsVbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(mesh.vertices[0]), &mesh.vertices[0][0],
-                 GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // The view may point into the mapped mesh cache, which goes straight to the GPU
+    {
+        TRACE_SCOPE("upload positions");
+        glGenBuffers(1, vertsVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vertsVbo[0]);
+        glBufferData(GL_ARRAY_BUFFER, meshView.num_vertices * positionBytes, positions, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
     // Create the buffer for colors
-    glGenBuffers(1, colorsVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, colorsVbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, mesh.colors.size() * sizeof(mesh.colors[0]), &mesh.colors[0][0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    {
+        TRACE_SCOPE("upload colors");
+        glGenBuffers(1, colorsVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, colorsVbo[0]);
+        glBufferData(GL_ARRAY_BUFFER, meshView.num_colors * attributeBytes, colors, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
     // Create the buffer for normals
-    glGenBuffers(1, normalsVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, normalsVbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(mesh.normals[0]), &mesh.normals[0][0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    {
+        TRACE_SCOPE("upload normals");
+        glGenBuffers(1, normalsVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, normalsVbo[0]);
+        glBufferData(GL_ARRAY_BUFFER, meshView.num_normals * attributeBytes, normals, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-    // Create the buffer for indices
-    glGenBuffers(1, facesIbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, facesIbo[0]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.faces.size() * sizeof(mesh.faces[0]), &mesh.faces[0][0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    // Create the buffer for indices, all the LOD levels or meshlets if those are drawn
+    const int *indices = useLod ? lod.indices.data() : useMeshlets ? meshlets.indices.data() : (const int *) meshView.faces;
+    const size_t numIndices = useLod ? lod.indices.size() : useMeshlets ? meshlets.indices.size() : meshView.num_faces * 3;
+    std::vector<uint16_t> shortIndices;
+    if (quantize && fitsShortIndices(meshView.num_vertices)) {
+        shortIndices = narrowIndices(indices, numIndices);
+        indexType = GL_UNSIGNED_SHORT;
+        indexSize = sizeof(uint16_t);
+    }
+    {
+        TRACE_SCOPE("upload indices");
+        glGenBuffers(1, facesIbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, facesIbo[0]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * indexSize,
+                     shortIndices.empty() ? (const void *) indices : shortIndices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
 
-    // Create the VAO
+    // Create the VAO, the index buffer binding is part of it
     glGenVertexArrays(1, &trisVao);
     glBindVertexArray(trisVao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, facesIbo[0]);
 
     int vertDim = 3;
 
     // location=0 is the vertex
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, vertsVbo[0]);
-    glVertexAttribPointer(0, vertDim, GL_FLOAT, GL_FALSE, sizeof(mesh.vertices[0]), 0);
+    if (quantize) { glVertexAttribPointer(0, vertDim, GL_UNSIGNED_SHORT, GL_TRUE, positionBytes, 0); }
+    else { glVertexAttribPointer(0, vertDim, GL_FLOAT, GL_FALSE, sizeof(Vec3f), 0); }
 
     // location=1 is the color
     glEnableVertexAttribArray(1);
     glBindBuffer(GL_ARRAY_BUFFER, colorsVbo[0]);
-    glVertexAttribPointer(1, vertDim, GL_FLOAT, GL_FALSE, sizeof(mesh.colors[0]), 0);
+    if (quantize) { glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, attributeBytes, 0); }
+    else { glVertexAttribPointer(1, vertDim, GL_FLOAT, GL_FALSE, sizeof(Vec3f), 0); }
 
-    // location=2 is the normal
+    // location=2 is the normal, packed ones need all four components
     glEnableVertexAttribArray(2);
     glBindBuffer(GL_ARRAY_BUFFER, normalsVbo[0]);
-    glVertexAttribPointer(2, vertDim, GL_FLOAT, GL_FALSE, sizeof(mesh.normals[0]), 0);
+    if (quantize) { glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, attributeBytes, 0); }
+    else { glVertexAttribPointer(2, vertDim, GL_FLOAT, GL_FALSE, sizeof(Vec3f), 0); }
 
     // Done setting data for the vao
     glBindVertexArray(0);
 
-    // Initialize the view matrix and projection matrix
-    setViewMatrix(Globals::eye, Globals::viewDir, Globals::upDir);
+    // Create the interleaved buffer, filled in place through a mapping
+    const size_t stride = quantize ? sizeof(InterleavedPackedVertex) : sizeof(InterleavedVertex);
+    void *mapped = nullptr;
+    if (canInterleave(meshView) && meshView.num_vertices > 0) {
+        glGenBuffers(1, interleavedVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, interleavedVbo[0]);
+        glBufferData(GL_ARRAY_BUFFER, meshView.num_vertices * stride, NULL, GL_STATIC_DRAW);
+        mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, meshView.num_vertices * stride,
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+    if (mapped == nullptr) {
+        if (interleaved) { cerr << "**Warning: Could not create the interleaved layout, using split buffers" << endl; }
+        interleaved = false;
+    } else {
+        TRACE_SCOPE("upload interleaved");
+        if (quantize) { fillInterleaved(meshView, positionQuantization, (InterleavedPackedVertex *) mapped); }
+        else { fillInterleaved(meshView, (InterleavedVertex *) mapped); }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+
+        // Create its VAO, same locations with one stride
+        glGenVertexArrays(1, &interleavedVao);
+        glBindVertexArray(interleavedVao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, facesIbo[0]);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        if (quantize) {
+            glVertexAttribPointer(0, vertDim, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                                  (const GLvoid *) offsetof(InterleavedPackedVertex, position));
+            glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                                  (const GLvoid *) offsetof(InterleavedPackedVertex, color));
+            glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                                  (const GLvoid *) offsetof(InterleavedPackedVertex, normal));
+        } else {
+            glVertexAttribPointer(0, vertDim, GL_FLOAT, GL_FALSE, stride, (const GLvoid *) offsetof(InterleavedVertex, position));
+            glVertexAttribPointer(1, vertDim, GL_FLOAT, GL_FALSE, stride, (const GLvoid *) offsetof(InterleavedVertex, color));
+            glVertexAttribPointer(2, vertDim, GL_FLOAT, GL_FALSE, stride, (const GLvoid *) offsetof(InterleavedVertex, normal));
+        }
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Initialize the projection matrix
     Globals::projectionMatrix = Mat4(near, far, Globals::left, Globals::right, bottom, top);
 }
 
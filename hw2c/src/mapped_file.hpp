@@ -0,0 +1,101 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() { close(); }
+
+    // Maps the file, false if it can't be opened
+    bool open(const std::string &file) {
+        close();
+#ifdef _WIN32
+        HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) { return false; }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(handle, &fileSize)) {
+            CloseHandle(handle);
+            return false;
+        }
+        length = (size_t) fileSize.QuadPart;
+        if (length > 0) {
+            HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                bytes = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(handle);
+        if (length > 0 && bytes == nullptr) {
+            length = 0;
+            return false;
+        }
+#else
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0) { return false; }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t) st.st_size;
+        if (length > 0) {
+            void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                bytes = (const char *) address;
+                madvise(address, length, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if (length > 0 && bytes == nullptr) {
+            length = 0;
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    void close() {
+        if (bytes != nullptr) {
+#ifdef _WIN32
+            UnmapViewOfFile(bytes);
+#else
+            munmap((void *) bytes, length);
+#endif
+        }
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char *data() const { return bytes; }
+
+    size_t size() const { return length; }
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+};
+
+#endif
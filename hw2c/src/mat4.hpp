@@ -3,12 +3,18 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <sstream>
 #include <vector>
 #include <algorithm>
 #include <utility>
 #include "vec3.hpp"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MAT4_SSE
+#include <xmmintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
 #endif
@@ -21,18 +27,30 @@ enum AXIS {
     X, Y, Z
 };
 
+//
+//	4x4 float matrix stored inline, 16 byte aligned and column-major, which is
+//	what glUniformMatrix4fv takes. Nothing allocates, so temporaries are free
+//	to make and copy. Multiply, transpose and transformVector use SSE and add
+//	the products in the same order as the scalar loops, so results don't change.
+//
+
 class Mat4 {
-    // row major order
-    std::vector<float> values;
-    const int nR, nC;
+    // column major order, element (i, j) is values[j * 4 + i]
+    alignas(16) float values[16];
 
     friend std::ostream &operator<<(std::ostream &, const Mat4 &);
 
+    float &at(int i, int j) { return values[j * 4 + i]; }
+
+    // Leaves the values unset, for results that are about to be overwritten
+    struct Uninitialized {};
+
+    explicit Mat4(Uninitialized) {}
+
 public:
 
     // Default is identity transform, can be initialized to ONES, ZEROS if needed
-    explicit Mat4(enum INIT init = IDENTITY) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(enum INIT init = IDENTITY) {
         switch (init) {
             case IDENTITY:
                 setIdentity();
@@ -50,135 +68,107 @@ public:
     }
 
     // Rotation about x,y,z axes transform
-    explicit Mat4(const float angleInDegrees, enum AXIS axis) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(const float angleInDegrees, enum AXIS axis) {
         setIdentity();
         switch (axis) {
             case X:
-                values[5] = cos(angleInDegrees / 180 * M_PI);
-                values[6] = -sin(angleInDegrees / 180 * M_PI);
-                values[9] = sin(angleInDegrees / 180 * M_PI);
-                values[10] = cos(angleInDegrees / 180 * M_PI);
+                at(1, 1) = cos(angleInDegrees / 180 * M_PI);
+                at(1, 2) = -sin(angleInDegrees / 180 * M_PI);
+                at(2, 1) = sin(angleInDegrees / 180 * M_PI);
+                at(2, 2) = cos(angleInDegrees / 180 * M_PI);
                 break;
             case Y:
-                values[0] = cos(angleInDegrees / 180 * M_PI);
-                values[2] = sin(angleInDegrees / 180 * M_PI);
-                values[8] = -sin(angleInDegrees / 180 * M_PI);
-                values[10] = cos(angleInDegrees / 180 * M_PI);
+                at(0, 0) = cos(angleInDegrees / 180 * M_PI);
+                at(0, 2) = sin(angleInDegrees / 180 * M_PI);
+                at(2, 0) = -sin(angleInDegrees / 180 * M_PI);
+                at(2, 2) = cos(angleInDegrees / 180 * M_PI);
                 break;
             case Z:
-                values[0] = cos(angleInDegrees / 180 * M_PI);
-                values[1] = -sin(angleInDegrees / 180 * M_PI);
-                values[4] = sin(angleInDegrees / 180 * M_PI);
-                values[5] = cos(angleInDegrees / 180 * M_PI);
+                at(0, 0) = cos(angleInDegrees / 180 * M_PI);
+                at(0, 1) = -sin(angleInDegrees / 180 * M_PI);
+                at(1, 0) = sin(angleInDegrees / 180 * M_PI);
+                at(1, 1) = cos(angleInDegrees / 180 * M_PI);
                 break;
         }
     }
 
     // Translation transform
-    explicit Mat4(const Vec3 translation) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(const Vec3 translation) {
         setIdentity();
-        values[3] = translation.x;
-        values[7] = translation.y;
-        values[11] = translation.z;
+        at(0, 3) = translation.x;
+        at(1, 3) = translation.y;
+        at(2, 3) = translation.z;
     }
 
     // Scale transform
-    explicit Mat4(const float scaleX, const float scaleY, const float scaleZ) : nR(4), nC(4) {
-        values.resize(nR * nC);
+    explicit Mat4(const float scaleX, const float scaleY, const float scaleZ) {
         setIdentity();
-        values[0] = scaleX;
-        values[5] = scaleY;
-        values[10] = scaleZ;
+        at(0, 0) = scaleX;
+        at(1, 1) = scaleY;
+        at(2, 2) = scaleZ;
     }
 
     // Perspective transform
     explicit Mat4(const float near, const float far,
                   const float left, const float right,
-                  const float bottom, const float top) : nR(4), nC(4) {
-        values.resize(nR * nC);
+                  const float bottom, const float top) {
         setIdentity();
-        values[0] = (2 * near) / (right - left);
-        values[2] = (right + left) / (right - left);
-        values[5] = (2 * near) / (top - bottom);
-        values[6] = (top + bottom) / (top - bottom);
-        values[10] = -(far + near) / (far - near);
-        values[11] = (-2 * far * near) / (far - near);
-        values[14] = -1;
-        values[15] = 0;
+        at(0, 0) = (2 * near) / (right - left);
+        at(0, 2) = (right + left) / (right - left);
+        at(1, 1) = (2 * near) / (top - bottom);
+        at(1, 2) = (top + bottom) / (top - bottom);
+        at(2, 2) = -(far + near) / (far - near);
+        at(2, 3) = (-2 * far * near) / (far - near);
+        at(3, 2) = -1;
+        at(3, 3) = 0;
     }
 
-    // Deep copy
-    Mat4(const Mat4 &m) : nR(m.nR), nC(m.nC) {
-        values.resize(nR * nC);
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = m.values[i * nC + j];
-            }
-        }
-    }
-
-    // Deep copy
-    void operator=(Mat4 const &m) {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = m.values[i * nC + j];
-            }
-        }
-    }
-
-    ~Mat4() = default;
-
     float get(const int &i, const int &j) const {
-        return values[i * nC + j];
+        return values[j * 4 + i];
     }
 
+    // Row major copy of the values
     std::vector<float> getAll() const {
+        const Mat4 transposed = ~*this;
+        return std::vector<float>(transposed.values, transposed.values + 16);
+    }
+
+    // Column major values, ready for glUniformMatrix4fv
+    const float *data() const {
         return values;
     }
 
     Vec3 getViewDirection() const {
-        return Vec3(values[8], values[9], values[10]) * -1;
+        return Vec3(get(2, 0), get(2, 1), get(2, 2)) * -1;
     }
 
     void set(const int &i, const int &j, const float &k) {
-        values[i * nC + j] = k;
+        values[j * 4 + i] = k;
     }
 
     Mat4 *setZeros() {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = 0;
-            }
-        }
+        std::fill(values, values + 16, 0.f);
         return this;
     }
 
     Mat4 *setOnes() {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = 1;
-            }
-        }
+        std::fill(values, values + 16, 1.f);
         return this;
     }
 
     Mat4 *setIdentity() {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                values[i * nC + j] = (i == j);
-            }
+        for (int k = 0; k < 16; ++k) {
+            values[k] = (k % 5 == 0);
         }
         return this;
     }
 
     Mat4 *setUniform(float low, float high) {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
                 float randomNumber = (float) rand() / RAND_MAX;
                 randomNumber = low + randomNumber * (high - low);
-                values[i * nC + j] = randomNumber;
+                at(i, j) = randomNumber;
             }
         }
         return this;
@@ -186,130 +176,174 @@ public:
 
     // Set as viewing matrix
     void setAsViewMatrix(Vec3 const &u, Vec3 const &v, Vec3 const &n, Vec3 const &d) {
-        values[0] = u.x;
-        values[1] = u.y;
-        values[2] = u.z;
-        values[3] = d.x;
-        values[4] = v.x;
-        values[5] = v.y;
-        values[6] = v.z;
-        values[7] = d.y;
-        values[8] = n.x;
-        values[9] = n.y;
-        values[10] = n.z;
-        values[11] = d.z;
-        values[12] = 0;
-        values[13] = 0;
-        values[14] = 0;
-        values[15] = 1;
+        const float rows[16] = {u.x, u.y, u.z, d.x,
+                                v.x, v.y, v.z, d.y,
+                                n.x, n.y, n.z, d.z,
+                                0, 0, 0, 1};
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                at(i, j) = rows[i * 4 + j];
+            }
+        }
     }
 
     // Transpose
     Mat4 operator~() const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[j * nR + i] = this->values[i * nC + j];
+        Mat4 result{Uninitialized()};
+#ifdef MAT4_SSE
+        __m128 c0 = _mm_load_ps(values), c1 = _mm_load_ps(values + 4);
+        __m128 c2 = _mm_load_ps(values + 8), c3 = _mm_load_ps(values + 12);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        _mm_store_ps(result.values, c0);
+        _mm_store_ps(result.values + 4, c1);
+        _mm_store_ps(result.values + 8, c2);
+        _mm_store_ps(result.values + 12, c3);
+#else
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                result.at(j, i) = get(i, j);
             }
         }
-
+#endif
         return result;
     }
 
     // Element-wise add
     Mat4 operator+(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] + m.values[i * nC + j];
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] + m.values[k];
         }
-
         return result;
     }
 
     // Element-wise subtract
     Mat4 operator-(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] - m.values[i * nC + j];
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] - m.values[k];
         }
-
         return result;
     }
 
-    // Matrix multiply
+    // Matrix multiply, column j of the result is this times column j of m
     Mat4 operator*(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < m.nC; ++j) {
-                float elementSum = 0;
-                for (int k = 0; k < nC; ++k) {
-                    elementSum += this->values[i * nC + k] * m.values[k * m.nC + j];
+        Mat4 result{Uninitialized()};
+#ifdef MAT4_SSE
+        const __m128 a0 = _mm_load_ps(values), a1 = _mm_load_ps(values + 4);
+        const __m128 a2 = _mm_load_ps(values + 8), a3 = _mm_load_ps(values + 12);
+        for (int j = 0; j < 4; ++j) {
+            const float *b = m.values + j * 4;
+            __m128 c = _mm_mul_ps(a0, _mm_set1_ps(b[0]));
+            c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(b[1])));
+            c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(b[2])));
+            c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(b[3])));
+            _mm_store_ps(result.values + j * 4, c);
+        }
+#else
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                float elementSum = get(i, 0) * m.get(0, j);
+                for (int k = 1; k < 4; ++k) {
+                    elementSum += get(i, k) * m.get(k, j);
                 }
-                result.values[i * m.nC + j] = elementSum;
+                result.at(i, j) = elementSum;
             }
         }
+#endif
         return result;
     }
 
     // Element-wise scalar multiply
     Mat4 operator*(float const &value) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] * value;
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] * value;
         }
-
         return result;
     }
 
+    // Transforms a direction, so translation is ignored
     Vec3 transformVector(Vec3 const &v) const {
-        Vec3 result(values[0] * v.x + values[1] * v.y + values[2] * v.z + values[3] * 0,
-                    values[4] * v.x + values[5] * v.y + values[6] * v.z + values[7] * 0,
-                    values[8] * v.x + values[9] * v.y + values[10] * v.z + values[11] * 0);
-
-        return result;
+#ifdef MAT4_SSE
+        __m128 r = _mm_mul_ps(_mm_load_ps(values), _mm_set1_ps(v.x));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(values + 4), _mm_set1_ps(v.y)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(values + 8), _mm_set1_ps(v.z)));
+        alignas(16) float result[4];
+        _mm_store_ps(result, r);
+        return Vec3(result[0], result[1], result[2]);
+#else
+        return Vec3(get(0, 0) * v.x + get(0, 1) * v.y + get(0, 2) * v.z,
+                    get(1, 0) * v.x + get(1, 1) * v.y + get(1, 2) * v.z,
+                    get(2, 0) * v.x + get(2, 1) * v.y + get(2, 2) * v.z);
+#endif
     }
 
     // Element-wise multiply
     Mat4 operator%(Mat4 const &m) const {
-        Mat4 result;
-
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                result.values[i * nC + j] = this->values[i * nC + j] * m.values[i * nC + j];
-            }
+        Mat4 result{Uninitialized()};
+        for (int k = 0; k < 16; ++k) {
+            result.values[k] = values[k] * m.values[k];
         }
+        return result;
+    }
 
+    // General inverse through the cofactors, the matrix must be invertible
+    Mat4 inverse() const {
+        const float *m = values;
+        Mat4 result{Uninitialized()};
+        float *r = result.values;
+        // 2x2 determinants of the bottom two rows and of the top two rows
+        const float b0 = m[2] * m[7] - m[3] * m[6], b1 = m[2] * m[11] - m[3] * m[10];
+        const float b2 = m[2] * m[15] - m[3] * m[14], b3 = m[6] * m[11] - m[7] * m[10];
+        const float b4 = m[6] * m[15] - m[7] * m[14], b5 = m[10] * m[15] - m[11] * m[14];
+        const float t0 = m[0] * m[5] - m[1] * m[4], t1 = m[0] * m[9] - m[1] * m[8];
+        const float t2 = m[0] * m[13] - m[1] * m[12], t3 = m[4] * m[9] - m[5] * m[8];
+        const float t4 = m[4] * m[13] - m[5] * m[12], t5 = m[8] * m[13] - m[9] * m[12];
+        const float inverseDeterminant = 1 / (t0 * b5 - t1 * b4 + t2 * b3 + t3 * b2 - t4 * b1 + t5 * b0);
+        r[0] = (m[5] * b5 - m[9] * b4 + m[13] * b3) * inverseDeterminant;
+        r[1] = (-m[1] * b5 + m[9] * b2 - m[13] * b1) * inverseDeterminant;
+        r[2] = (m[1] * b4 - m[5] * b2 + m[13] * b0) * inverseDeterminant;
+        r[3] = (-m[1] * b3 + m[5] * b1 - m[9] * b0) * inverseDeterminant;
+        r[4] = (-m[4] * b5 + m[8] * b4 - m[12] * b3) * inverseDeterminant;
+        r[5] = (m[0] * b5 - m[8] * b2 + m[12] * b1) * inverseDeterminant;
+        r[6] = (-m[0] * b4 + m[4] * b2 - m[12] * b0) * inverseDeterminant;
+        r[7] = (m[0] * b3 - m[4] * b1 + m[8] * b0) * inverseDeterminant;
+        r[8] = (m[7] * t5 - m[11] * t4 + m[15] * t3) * inverseDeterminant;
+        r[9] = (-m[3] * t5 + m[11] * t2 - m[15] * t1) * inverseDeterminant;
+        r[10] = (m[3] * t4 - m[7] * t2 + m[15] * t0) * inverseDeterminant;
+        r[11] = (-m[3] * t3 + m[7] * t1 - m[11] * t0) * inverseDeterminant;
+        r[12] = (-m[6] * t5 + m[10] * t4 - m[14] * t3) * inverseDeterminant;
+        r[13] = (m[2] * t5 - m[10] * t2 + m[14] * t1) * inverseDeterminant;
+        r[14] = (-m[2] * t4 + m[6] * t2 - m[14] * t0) * inverseDeterminant;
+        r[15] = (m[2] * t3 - m[6] * t1 + m[10] * t0) * inverseDeterminant;
         return result;
     }
 
-    void dumpColumnWise(float *array) const {
-        for (int i = 0; i < nR; ++i) {
-            for (int j = 0; j < nC; ++j) {
-                array[i + j * nR] = this->values[i * nC + j];
+    // Upper 3x3 of the inverse transpose, column major for glUniformMatrix3fv.
+    // Transforms normals so they stay perpendicular under non-uniform scales.
+    void dumpNormalMatrix(float *array) const {
+        const Mat4 i = inverse();
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 3; ++k) {
+                array[j * 3 + k] = i.get(j, k);
             }
         }
     }
 
+    void dumpColumnWise(float *array) const {
+        std::memcpy(array, values, sizeof(values));
+    }
+
     Vec3 getTranslationVec3() const {
-        return {values[3], values[7], values[11]};
+        return {get(0, 3), get(1, 3), get(2, 3)};
     }
 };
 
 std::ostream &operator<<(std::ostream &out, const Mat4 &m) {
-    for (int i = 0; i < m.nR; ++i) {
-        for (int j = 0; j < m.nC; ++j) {
-            out << m.values[i * m.nC + j] << " ";
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            out << m.get(i, j) << " ";
         }
         out << std::endl;
     }
@@ -0,0 +1,234 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Binary cache of a loaded TriMesh, so later runs can skip parsing the OBJ.
+//	The file is a header followed by the position, normal, color and face
+//	blocks, each aligned to MESH_CACHE_ALIGNMENT bytes. A cache is only used
+//	if its version, load flags and the hash and size of the OBJ all match
+//	and its faces only index vertices it has.
+//
+
+const uint32_t MESH_CACHE_VERSION = 1;
+const size_t MESH_CACHE_ALIGNMENT = 64;
+
+// Load flags, a cache made with different flags is not used
+const uint32_t MESH_CACHE_DEDUPLICATED = 1u << 0;
+const uint32_t MESH_CACHE_VERTEX_CACHE_OPTIMIZED = 1u << 1;
+const uint32_t MESH_CACHE_FITTED = 1u << 2;
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint64_t numVertices, numNormals, numColors, numFaces;
+    uint64_t verticesOffset, normalsOffset, colorsOffset, facesOffset;
+};
+
+static const char MESH_CACHE_MAGIC[8] = {'H', 'W', '2', 'C', 'M', 'E', 'S', 'H'};
+
+static inline uint64_t hashMix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Hash of one block, four independent lanes of 8 byte words
+static uint64_t hashBlock(const char *p, size_t n, uint64_t seed) {
+    uint64_t h[4] = {seed, seed + 0x9e3779b97f4a7c15ull, seed + 0x3c6ef372fe94f82aull, seed + 0xdaa66d2c7ddf743full};
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int l = 0; l < 4; ++l) {
+            uint64_t w;
+            std::memcpy(&w, p + i + 8 * l, 8);
+            h[l] = (h[l] ^ w) * 0x100000001b3ull;
+            h[l] ^= h[l] >> 29;
+        }
+    }
+    for (int l = 0; i + 8 <= n; i += 8, ++l) { // whole words left, at most three
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h[l] = (h[l] ^ w) * 0x100000001b3ull;
+        h[l] ^= h[l] >> 29;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, p + i, n - i);
+    return hashMix(h[0] ^ hashMix(h[1]) ^ hashMix(hashMix(h[2])) ^ hashMix(h[3] + tail) ^ n);
+}
+
+// Content hash of a byte range. Blocks are hashed in parallel
+// but have a fixed size, so the result doesn't depend on threads.
+static uint64_t hashBytes(const char *data, size_t size) {
+    const size_t blockSize = 16 << 20;
+    const int numBlocks = (int) ((size + blockSize - 1) / blockSize);
+    std::vector<uint64_t> blocks(numBlocks);
+    ThreadPool::global().parallelFor(numBlocks, [&](int i) {
+        size_t begin = i * blockSize;
+        blocks[i] = hashBlock(data + begin, std::min(blockSize, size - begin), i);
+    });
+    uint64_t h = hashMix(size);
+    for (uint64_t b : blocks) { h = hashMix(h ^ b); }
+    return h;
+}
+
+// Hashes a file's contents, false if it can't be read
+static bool hashFile(const std::string &file, uint64_t *hash, uint64_t *size) {
+    MappedFile mapped;
+    if (!mapped.open(file)) { return false; }
+    *hash = hashBytes(mapped.data(), mapped.size());
+    *size = mapped.size();
+    return true;
+}
+
+// Cache file in directory for objFile loaded with flags. The name keeps the
+// OBJ's for a reader and adds a hash of its absolute path and the flags, so
+// same named OBJs in other directories and other load flags don't keep
+// overwriting each other's cache.
+static std::string meshCacheFile(const std::string &directory, const std::string &objFile, uint32_t flags) {
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::absolute(objFile, error);
+    if (error) { path = objFile; }
+    const std::string key = path.lexically_normal().string();
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hashMix(hashBytes(key.data(), key.size()) ^ flags));
+    return directory + path.filename().string() + "." + hex + ".mesh";
+}
+
+// Writes mesh to a cache file for an OBJ with the given hash and size
+static bool writeMeshCache(const std::string &file, const TriMesh &mesh, uint32_t flags,
+                           uint64_t sourceHash, uint64_t sourceSize) {
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.flags = flags;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.numVertices = mesh.vertices.size();
+    header.numNormals = mesh.normals.size();
+    header.numColors = mesh.colors.size();
+    header.numFaces = mesh.faces.size();
+
+    auto align = [](uint64_t offset) { return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT; };
+    header.verticesOffset = align(sizeof(header));
+    header.normalsOffset = align(header.verticesOffset + header.numVertices * sizeof(Vec3f));
+    header.colorsOffset = align(header.normalsOffset + header.numNormals * sizeof(Vec3f));
+    header.facesOffset = align(header.colorsOffset + header.numColors * sizeof(Vec3f));
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path(), error);
+
+    // Write to a temporary file first so a cache is never half written
+    const std::string temp = file + ".tmp";
+    FILE *fp = std::fopen(temp.c_str(), "wb");
+    if (fp == nullptr) { return false; }
+    bool ok = true;
+    uint64_t offset = 0;
+    auto write = [&](uint64_t at, const void *data, size_t bytes) {
+        static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+        ok = ok && std::fwrite(zeros, 1, at - offset, fp) == at - offset;
+        ok = ok && (bytes == 0 || std::fwrite(data, 1, bytes, fp) == bytes);
+        offset = at + bytes;
+    };
+    write(0, &header, sizeof(header));
+    write(header.verticesOffset, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vec3f));
+    write(header.normalsOffset, mesh.normals.data(), mesh.normals.size() * sizeof(Vec3f));
+    write(header.colorsOffset, mesh.colors.data(), mesh.colors.size() * sizeof(Vec3f));
+    write(header.facesOffset, mesh.faces.data(), mesh.faces.size() * sizeof(Vec3i));
+    ok = std::fclose(fp) == 0 && ok;
+    if (ok) {
+        std::filesystem::rename(temp, file, error);
+        ok = !error;
+    }
+    if (!ok) { std::remove(temp.c_str()); }
+    return ok;
+}
+
+// Memory mapped cache file. The mesh arrays point straight into the
+// mapping, so they can be uploaded to the GPU without any copies.
+class MeshCache {
+public:
+    // Maps a cache file, false if it is missing, corrupt or out of date
+    bool open(const std::string &file, uint32_t flags, uint64_t sourceHash, uint64_t sourceSize) {
+        header = nullptr;
+        if (!mapped.open(file) || mapped.size() < sizeof(MeshCacheHeader)) { return false; }
+        const MeshCacheHeader *h = (const MeshCacheHeader *) mapped.data();
+        if (std::memcmp(h->magic, MESH_CACHE_MAGIC, sizeof(h->magic)) != 0 || h->version != MESH_CACHE_VERSION ||
+            h->flags != flags || h->sourceHash != sourceHash || h->sourceSize != sourceSize) {
+            mapped.close();
+            return false;
+        }
+        auto inside = [&](uint64_t offset, uint64_t count, size_t stride) {
+            return offset % MESH_CACHE_ALIGNMENT == 0 && offset <= mapped.size() &&
+                   count <= (mapped.size() - offset) / stride;
+        };
+        if (!inside(h->verticesOffset, h->numVertices, sizeof(Vec3f)) ||
+            !inside(h->normalsOffset, h->numNormals, sizeof(Vec3f)) ||
+            !inside(h->colorsOffset, h->numColors, sizeof(Vec3f)) ||
+            !inside(h->facesOffset, h->numFaces, sizeof(Vec3i))) {
+            mapped.close();
+            return false;
+        }
+        if (!facesInRange((const Vec3i *) (mapped.data() + h->facesOffset), h->numFaces, h->numVertices)) {
+            mapped.close();
+            return false;
+        }
+        header = h;
+        return true;
+    }
+
+    void close() {
+        mapped.close();
+        header = nullptr;
+    }
+
+    MeshView view() const {
+        MeshView v;
+        if (header == nullptr) { return v; }
+        v.vertices = (const Vec3f *) (mapped.data() + header->verticesOffset);
+        v.normals = (const Vec3f *) (mapped.data() + header->normalsOffset);
+        v.colors = (const Vec3f *) (mapped.data() + header->colorsOffset);
+        v.faces = (const Vec3i *) (mapped.data() + header->facesOffset);
+        v.num_vertices = header->numVertices;
+        v.num_normals = header->numNormals;
+        v.num_colors = header->numColors;
+        v.num_faces = header->numFaces;
+        return v;
+    }
+
+private:
+    MappedFile mapped;
+    const MeshCacheHeader *header = nullptr;
+
+    // Whether every index of the faces is a vertex, so a damaged cache can't
+    // send the GPU or the CPU passes off the end of the vertices
+    static bool facesInRange(const Vec3i *faces, size_t numFaces, uint64_t numVertices) {
+        std::atomic<bool> ok{true};
+        ThreadPool::global().parallelForRange(numFaces, 1 << 16, [&](size_t begin, size_t end) {
+            int bad = 0;
+            for (size_t f = begin; f < end; ++f) {
+                for (int k = 0; k < 3; ++k) { bad |= (uint64_t) (uint32_t) faces[f][k] >= numVertices; }
+            }
+            if (bad) { ok.store(false, std::memory_order_relaxed); }
+        });
+        return ok.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "face_partition.hpp"
+#include "parallel.hpp"
+#include "trimesh.hpp"
+
+//
+//	Meshlets: small clusters of at most maxVertices vertices and maxTriangles
+//	triangles, each with a bounding sphere and a cone around its triangle normals.
+//	Every frame, meshlets outside the view frustum and meshlets whose triangles
+//	all face away from the eye are skipped on the CPU, and only the index ranges
+//	of the others are drawn. Meshlets grow greedily by the neighbouring triangle
+//	that adds the fewest new vertices, and then is closest to the meshlet center.
+//
+
+struct Meshlet {
+    size_t offset; // first index in MeshletMesh::indices
+    unsigned numVertices, numTriangles;
+    float center[3], radius;
+    float coneAxis[3], coneCos, coneSin; // all normals are within the cone, coneCos <= 0 if it is too wide to cull
+};
+
+class MeshletMesh {
+public:
+    std::vector<Meshlet> meshlets;
+    std::vector<int> indices;
+
+    // What the last cull kept, as merged index ranges (offset, count)
+    std::vector<std::pair<size_t, size_t>> visible;
+
+    static const unsigned maxVertices = 64;
+    static const unsigned maxTriangles = 124;
+
+    // Meshlets are built in parallel within groups of this many nearby triangles
+    static const size_t groupFaces = 4096;
+
+    void build(const MeshView &mesh) {
+        meshlets.clear();
+        indices.clear();
+        visible.clear();
+
+        std::vector<int> order;
+        std::vector<std::pair<size_t, size_t>> ranges;
+        partitionFaces(mesh, groupFaces, order, ranges);
+
+        std::vector<std::vector<Meshlet>> groupMeshlets(ranges.size());
+        std::vector<std::vector<int>> groupIndices(ranges.size());
+        ThreadPool::global().parallelFor(ranges.size(), [&](int g) {
+            buildGroup(mesh, order.data() + ranges[g].first, ranges[g].second - ranges[g].first,
+                       groupMeshlets[g], groupIndices[g]);
+        });
+
+        // Concatenate in group order
+        for (size_t g = 0; g < ranges.size(); ++g) {
+            for (Meshlet m : groupMeshlets[g]) {
+                m.offset += indices.size();
+                meshlets.push_back(m);
+            }
+            indices.insert(indices.end(), groupIndices[g].begin(), groupIndices[g].end());
+        }
+    }
+
+    // Fills visible with the meshlets inside the frustum of clip (model to clip space,
+    // column major) that face eye (in model space). Returns the triangles culled.
+    size_t cull(const float clip[16], const float eye[3]) {
+        // Frustum planes, inside if dot(plane.xyz, p) + plane.w >= 0
+        float planes[6][4];
+        for (int p = 0; p < 6; ++p) {
+            int row = p / 2;
+            float sign = p % 2 == 0 ? 1.f : -1.f;
+            float length = 0;
+            for (int c = 0; c < 4; ++c) {
+                planes[p][c] = clip[c * 4 + 3] + sign * clip[c * 4 + row];
+                if (c < 3) { length += planes[p][c] * planes[p][c]; }
+            }
+            length = std::sqrt(length);
+            for (int c = 0; c < 4; ++c) { planes[p][c] /= length > 0 ? length : 1; }
+        }
+
+        size_t culled = 0;
+        visible.clear();
+        for (const Meshlet &m : meshlets) {
+            if (outsideFrustum(m, planes) || facesAway(m, eye)) {
+                culled += m.numTriangles;
+                continue;
+            }
+            // Meshlets are contiguous in indices, so neighbours merge into one draw
+            if (!visible.empty() && visible.back().first + visible.back().second == m.offset) {
+                visible.back().second += m.numTriangles * 3;
+            } else {
+                visible.emplace_back(m.offset, m.numTriangles * 3);
+            }
+        }
+        return culled;
+    }
+
+    void printDetails() const {
+        size_t vertices = 0, cullable = 0;
+        for (const Meshlet &m : meshlets) {
+            vertices += m.numVertices;
+            if (m.coneCos > 0) { ++cullable; }
+        }
+        std::cout << "Meshlets: " << meshlets.size() << ", average " << (float) indices.size() / 3 / std::max<size_t>(meshlets.size(), 1)
+                  << " triangles and " << (float) vertices / std::max<size_t>(meshlets.size(), 1) << " vertices, "
+                  << cullable << " with a cullable normal cone" << std::endl;
+    }
+
+private:
+    static bool outsideFrustum(const Meshlet &m, const float planes[6][4]) {
+        for (int p = 0; p < 6; ++p) {
+            if (planes[p][0] * m.center[0] + planes[p][1] * m.center[1] + planes[p][2] * m.center[2] + planes[p][3] < -m.radius) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // True if every triangle is back facing from every point of the bounding sphere:
+    // the angle between the eye to center direction and the cone axis plus the
+    // cone's half angle must keep all normals at least radius away from facing the eye.
+    static bool facesAway(const Meshlet &m, const float eye[3]) {
+        if (m.coneCos <= 0) { return false; }
+        float v[3] = {m.center[0] - eye[0], m.center[1] - eye[1], m.center[2] - eye[2]};
+        float distance = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (distance <= m.radius) { return false; }
+        float cosA = (v[0] * m.coneAxis[0] + v[1] * m.coneAxis[1] + v[2] * m.coneAxis[2]) / distance;
+        float sinA = std::sqrt(std::max(0.f, 1 - cosA * cosA));
+        return cosA * m.coneCos - sinA * m.coneSin >= m.radius / distance; // cos(A + cone angle)
+    }
+
+    // Greedy meshlets over n faces, indices are relative to this group
+    static void buildGroup(const MeshView &mesh, const int *faces, size_t n, std::vector<Meshlet> &out,
+                           std::vector<int> &outIndices) {
+        // Local vertex ids and vertex to face adjacency
+        std::unordered_map<int, int> local;
+        std::vector<int> global, tris(n * 3);
+        local.reserve(n * 2);
+        for (size_t t = 0; t < n; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                int v = mesh.faces[faces[t]][k];
+                auto inserted = local.emplace(v, (int) global.size());
+                if (inserted.second) { global.push_back(v); }
+                tris[t * 3 + k] = inserted.first->second;
+            }
+        }
+        const int nv = global.size();
+        std::vector<int> offsets(nv + 1, 0), adjacency(n * 3);
+        for (int v : tris) { ++offsets[v + 1]; }
+        for (int v = 0; v < nv; ++v) { offsets[v + 1] += offsets[v]; }
+        std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < n; ++t) { for (int k = 0; k < 3; ++k) { adjacency[fill[tris[t * 3 + k]]++] = t; } }
+
+        std::vector<char> emitted(n, 0);
+        std::vector<int> inMeshlet(nv, -1); // meshlet a vertex was last added to
+        std::vector<int> live(nv); // unemitted triangles around a vertex
+        for (int v = 0; v < nv; ++v) { live[v] = offsets[v + 1] - offsets[v]; }
+        std::vector<int> current, frontier; // triangles around the current meshlet's vertices
+        unsigned currentVertices = 0;
+        float sum[3] = {0, 0, 0}; // of the current meshlet's vertices
+        int id = 0;
+        size_t cursor = 0;
+
+        auto newVertices = [&](int t) {
+            int count = 0;
+            for (int k = 0; k < 3; ++k) { count += inMeshlet[tris[t * 3 + k]] != id; }
+            return count;
+        };
+        auto flush = [&]() {
+            if (current.empty()) { return; }
+            Meshlet m;
+            m.offset = outIndices.size();
+            m.numVertices = currentVertices;
+            m.numTriangles = current.size();
+            for (int t : current) { for (int k = 0; k < 3; ++k) { outIndices.push_back(global[tris[t * 3 + k]]); } }
+            bounds(mesh, outIndices.data() + m.offset, m);
+            out.push_back(m);
+            current.clear();
+            frontier.clear();
+            currentVertices = 0;
+            sum[0] = sum[1] = sum[2] = 0;
+            ++id;
+        };
+        auto liveness = [&](int t) { return live[tris[t * 3]] + live[tris[t * 3 + 1]] + live[tris[t * 3 + 2]]; };
+        auto distance2 = [&](int t) {
+            float d2 = 0;
+            for (int a = 0; a < 3; ++a) {
+                float c = 0;
+                for (int k = 0; k < 3; ++k) { c += mesh.vertices[global[tris[t * 3 + k]]][a]; }
+                float d = c / 3 - sum[a] / currentVertices;
+                d2 += d * d;
+            }
+            return d2;
+        };
+
+        for (size_t added = 0; added < n; ++added) {
+            // Best unemitted triangle around the meshlet, dropping emitted ones from the frontier.
+            // Triangles whose vertices have few others left go first, so none are left stranded.
+            int best = -1, bestNew = 4, bestLive = 0;
+            float bestDistance = HUGE_VALF;
+            size_t kept = 0;
+            for (int t : frontier) {
+                if (emitted[t]) { continue; }
+                frontier[kept++] = t;
+                int count = newVertices(t);
+                if (count > bestNew) { continue; }
+                int l = liveness(t);
+                if (count == bestNew && l > bestLive) { continue; }
+                float d2 = distance2(t);
+                if (count < bestNew || l < bestLive || d2 < bestDistance) {
+                    best = t;
+                    bestNew = count;
+                    bestLive = l;
+                    bestDistance = d2;
+                }
+            }
+            frontier.resize(kept);
+            // Otherwise start over from the first triangle left
+            if (best < 0) {
+                flush();
+                while (emitted[cursor]) { ++cursor; }
+                best = cursor;
+                bestNew = newVertices(best);
+            }
+            if (current.size() == maxTriangles || currentVertices + bestNew > maxVertices) {
+                flush();
+                bestNew = 3;
+            }
+            for (int k = 0; k < 3; ++k) {
+                int v = tris[best * 3 + k];
+                if (inMeshlet[v] != id) {
+                    inMeshlet[v] = id;
+                    ++currentVertices;
+                    for (int a = 0; a < 3; ++a) { sum[a] += mesh.vertices[global[v]][a]; }
+                    for (int a = offsets[v]; a < offsets[v + 1]; ++a) {
+                        if (!emitted[adjacency[a]]) { frontier.push_back(adjacency[a]); }
+                    }
+                }
+            }
+            emitted[best] = 1;
+            current.push_back(best);
+            for (int k = 0; k < 3; ++k) { --live[tris[best * 3 + k]]; }
+        }
+        flush();
+    }
+
+    // Bounding sphere and normal cone of the triangles starting at indices
+    static void bounds(const MeshView &mesh, const int *indices, Meshlet &m) {
+        const int n = m.numTriangles * 3;
+        float lo[3] = {HUGE_VALF, HUGE_VALF, HUGE_VALF}, hi[3] = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+        for (int i = 0; i < n; ++i) {
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = std::min(lo[a], mesh.vertices[indices[i]][a]);
+                hi[a] = std::max(hi[a], mesh.vertices[indices[i]][a]);
+            }
+        }
+        float r2 = 0;
+        for (int a = 0; a < 3; ++a) { m.center[a] = (lo[a] + hi[a]) / 2; }
+        for (int i = 0; i < n; ++i) {
+            float d2 = 0;
+            for (int a = 0; a < 3; ++a) {
+                float d = mesh.vertices[indices[i]][a] - m.center[a];
+                d2 += d * d;
+            }
+            r2 = std::max(r2, d2);
+        }
+        m.radius = std::sqrt(r2);
+
+        // Cone axis is the average unit normal, its angle reaches the furthest normal
+        std::vector<Vec3f> normals;
+        Vec3f axis(0, 0, 0);
+        for (int i = 0; i < n; i += 3) {
+            const Vec3f &p0 = mesh.vertices[indices[i]];
+            Vec3f normal = (mesh.vertices[indices[i + 1]] - p0).cross(mesh.vertices[indices[i + 2]] - p0);
+            float length = normal.len();
+            if (length <= 0) { continue; }
+            normals.push_back(normal * (1 / length));
+            axis += normals.back();
+        }
+        float length = axis.len();
+        m.coneCos = 0;
+        m.coneSin = 1;
+        for (int a = 0; a < 3; ++a) { m.coneAxis[a] = length > 0 ? axis[a] / length : 0; }
+        if (length <= 0) { return; }
+        float minDot = 1;
+        for (const Vec3f &normal : normals) {
+            minDot = std::min(minDot, normal[0] * m.coneAxis[0] + normal[1] * m.coneAxis[1] + normal[2] * m.coneAxis[2]);
+        }
+        m.coneCos = minDot;
+        m.coneSin = std::sqrt(std::max(0.f, 1 - minDot * minDot));
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+// Fixed set of worker threads that share the iterations of parallelFor calls.
+// The calling thread works too, so a pool of size n has n-1 workers.
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads = 0) {
+        if (numThreads <= 0) { numThreads = std::max(1u, std::thread::hardware_concurrency()); }
+        for (int i = 1; i < numThreads; ++i) { workers.emplace_back([this] { workerLoop(); }); }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers) { worker.join(); }
+    }
+
+    int size() const { return (int) workers.size() + 1; }
+
+    // Runs f(i) for all i in [0,n) on at most maxThreads threads (0 for all of them)
+    // and returns when every call is done. Nested calls run serially.
+    void parallelFor(int n, const std::function<void(int)> &f, int maxThreads = 0) {
+        int helpers = std::min((maxThreads > 0 ? maxThreads : size()) - 1, n - 1);
+        helpers = std::min(helpers, (int) workers.size());
+        if (helpers <= 0 || insideJob) {
+            for (int i = 0; i < n; ++i) { f(i); }
+            return;
+        }
+
+        std::lock_guard<std::mutex> callLock(callMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &f;
+            jobSize = n;
+            next = 0;
+            slots = helpers;
+            ++generation;
+        }
+        wake.notify_all();
+        insideJob = true;
+        runJob(f, n);
+        insideJob = false;
+
+        // Workers that haven't picked up the job yet no longer need to
+        std::unique_lock<std::mutex> lock(mutex);
+        slots = 0;
+        done.wait(lock, [this] { return running == 0; });
+    }
+
+    // Runs f(begin, end) on the blocks of [0,n), blockSize long but for the last,
+    // the way parallelFor runs f(i)
+    template<typename F>
+    void parallelForRange(size_t n, size_t blockSize, const F &f, int maxThreads = 0) {
+        parallelFor((int) ((n + blockSize - 1) / blockSize), [&](int b) {
+            const size_t begin = (size_t) b * blockSize;
+            f(begin, std::min(n, begin + blockSize));
+        }, maxThreads);
+    }
+
+    // Pool shared by the whole program
+    static ThreadPool &global() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex callMutex, mutex;
+    std::condition_variable wake, done;
+    bool quit = false;
+
+    // Current job, guarded by mutex except for next
+    const std::function<void(int)> *job = nullptr;
+    int jobSize = 0, slots = 0, running = 0;
+    unsigned long generation = 0;
+    std::atomic<int> next{0};
+
+    static inline thread_local bool insideJob = false;
+
+    void runJob(const std::function<void(int)> &f, int n) {
+        for (int i = next++; i < n; i = next++) { f(i); }
+    }
+
+    void workerLoop() {
+        TRACE_THREAD_NAME("pool worker");
+        insideJob = true;
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return quit || (generation != seen && slots > 0); });
+            if (quit) { return; }
+            seen = generation;
+            --slots;
+            ++running;
+            const std::function<void(int)> &f = *job;
+            int n = jobSize;
+            lock.unlock();
+            runJob(f, n);
+            lock.lock();
+            if (--running == 0) { done.notify_all(); }
+        }
+    }
+};
+
+#endif
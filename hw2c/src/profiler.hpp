@@ -0,0 +1,244 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_EGL
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#endif
+
+#include "trace.hpp"
+
+//
+//	Where the frame time goes, phase by phase. Each phase is timed on the CPU
+//	with the steady clock and, unless it is CPU only, on the GPU with a
+//	GL_TIME_ELAPSED query around the commands it issues. Queries are kept in
+//	a ring FRAMES_IN_FLIGHT frames deep and a frame's results are read when
+//	its slot comes around again, if the GPU has them by then. A result that
+//	isn't ready is dropped rather than waited for, so reading never stalls
+//	the pipeline. Times go into rolling windows of the last few seconds for
+//	their percentiles. GPU phases must not nest, one GL_TIME_ELAPSED query can
+//	be active at a time. Results are read as 64 bit values, glGetQueryObjectui64v
+//	is looked up at init as gl3.h doesn't declare it. When tracing, the phases and frames are spans in the
+//	trace too, see trace.hpp.
+//
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+typedef void (GL_APIENTRYP GetQueryObjectui64vProc)(GLuint id, GLenum pname, GLuint64 *params);
+
+// The last SIZE values of something, with their percentiles
+class RollingStats {
+public:
+    static constexpr size_t SIZE = 240; // 4 s at 60 fps
+
+    void add(double v) {
+        samples[next] = (float) v;
+        next = (next + 1) % SIZE;
+        count = std::min(count + 1, SIZE);
+    }
+
+    size_t size() const { return count; }
+
+    double mean() const {
+        double total = 0;
+        for (size_t i = 0; i < count; ++i) { total += samples[i]; }
+        return count > 0 ? total / count : 0;
+    }
+
+    // Median, 95th and 99th percentile, with one sort of a copy
+    void percentiles(double &p50, double &p95, double &p99) const {
+        p50 = p95 = p99 = 0;
+        if (count == 0) { return; }
+        std::array<float, SIZE> sorted;
+        std::copy(samples.begin(), samples.begin() + count, sorted.begin());
+        std::sort(sorted.begin(), sorted.begin() + count);
+        auto at = [&](double p) { return sorted[std::min(count - 1, (size_t) (p * count))]; };
+        p50 = at(0.5);
+        p95 = at(0.95);
+        p99 = at(0.99);
+    }
+
+private:
+    std::array<float, SIZE> samples;
+    size_t count = 0, next = 0;
+};
+
+class FrameProfiler {
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 4; // a query is read back this many frames after it was issued
+
+    struct Phase {
+        std::string name;
+        bool gpu;
+        RollingStats cpu, gpuTime; // milliseconds
+    };
+
+    FrameProfiler() = default;
+    FrameProfiler(const FrameProfiler &) = delete;
+    FrameProfiler &operator=(const FrameProfiler &) = delete;
+
+    // Adds a phase and returns its id for begin and end. A GPU phase also
+    // times the GL commands issued in it. Phases are added before init, and
+    // before tracing starts, which keeps the names the trace points to.
+    int add(const std::string &name, bool gpu = true) {
+        phaseList.push_back({name, gpu, RollingStats(), RollingStats()});
+        starts.push_back(0);
+        return (int) phaseList.size() - 1;
+    }
+
+    // Creates the queries, once a context is current. Without init only CPU times are taken.
+    void init() {
+        destroy();
+        getQueryObjectui64v = loadGetQueryObjectui64v();
+        queries.resize(FRAMES_IN_FLIGHT * phaseList.size());
+        issuedAt.assign(queries.size(), 0);
+        glGenQueries((GLsizei) queries.size(), queries.data());
+    }
+
+    void destroy() {
+        if (!queries.empty()) { glDeleteQueries((GLsizei) queries.size(), queries.data()); }
+        queries.clear();
+        issuedAt.clear();
+    }
+
+    // Starts a frame, and reads back the GPU times the last frame in this
+    // slot of the ring left, the ones that are done
+    void beginFrame() {
+        const double now = seconds();
+        if (frameStart > 0) { frame.add((now - frameStart) * 1000); }
+        frameStart = now;
+        slot = frameNumber % FRAMES_IN_FLIGHT;
+        for (size_t p = 0; p < phaseList.size() && !queries.empty(); ++p) {
+            const size_t q = slot * phaseList.size() + p;
+            if (issuedAt[q] == 0) { continue; }
+            const double elapsed = now - issuedAt[q];
+            issuedAt[q] = 0;
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                ++dropped;
+                continue;
+            }
+            GLuint64 nanoseconds = 0;
+            if (getQueryObjectui64v != nullptr) { getQueryObjectui64v(queries[q], GL_QUERY_RESULT, &nanoseconds); }
+            else {
+                GLuint clamped = 0; // at UINT32_MAX if the time doesn't fit, which the check below drops
+                glGetQueryObjectuiv(queries[q], GL_QUERY_RESULT, &clamped);
+                nanoseconds = clamped;
+            }
+            // No phase takes longer than it has been since it began. Some drivers
+            // return nonsense for the first query of a context.
+            if (nanoseconds * 1e-9 > elapsed) {
+                ++dropped;
+                continue;
+            }
+            phaseList[p].gpuTime.add(nanoseconds * 1e-6);
+        }
+    }
+
+    void endFrame() {
+        TRACE_SPAN("frame", frameStart, seconds());
+        ++frameNumber;
+    }
+
+    void begin(int phase) {
+        Phase &p = phaseList[phase];
+        if (p.gpu && !queries.empty() && activeQuery < 0) {
+            activeQuery = phase;
+            const size_t q = slot * phaseList.size() + phase;
+            glBeginQuery(GL_TIME_ELAPSED, queries[q]);
+            issuedAt[q] = seconds();
+        }
+        starts[phase] = seconds();
+    }
+
+    void end(int phase) {
+        const double now = seconds();
+        phaseList[phase].cpu.add((now - starts[phase]) * 1000);
+        TRACE_SPAN(phaseList[phase].name.c_str(), starts[phase], now);
+        if (activeQuery == phase) {
+            glEndQuery(GL_TIME_ELAPSED);
+            activeQuery = -1;
+        }
+    }
+
+    const std::vector<Phase> &phases() const { return phaseList; }
+
+    // Milliseconds from one beginFrame to the next
+    const RollingStats &frameTimes() const { return frame; }
+
+    // GPU results that weren't ready when their slot came around, or couldn't be right
+    size_t droppedResults() const { return dropped; }
+
+    // A table of the phases' percentiles over the last frames
+    void print() const {
+        double p50, p95, p99;
+        std::printf("%-16s %26s %26s\n", "phase ms", "CPU p50     p95     p99", "GPU p50     p95     p99");
+        for (const Phase &p : phaseList) {
+            if (p.cpu.size() == 0) { continue; }
+            p.cpu.percentiles(p50, p95, p99);
+            std::printf("%-16s %10.3f %7.3f %7.3f", p.name.c_str(), p50, p95, p99);
+            if (p.gpu && p.gpuTime.size() > 0) {
+                p.gpuTime.percentiles(p50, p95, p99);
+                std::printf(" %10.3f %7.3f %7.3f", p50, p95, p99);
+            }
+            std::printf("\n");
+        }
+        frame.percentiles(p50, p95, p99);
+        std::printf("%-16s %10.3f %7.3f %7.3f\n", "frame", p50, p95, p99);
+        if (dropped > 0) { std::printf("%zu GPU results were not ready in time or impossible, and dropped\n", dropped); }
+    }
+
+private:
+    std::vector<Phase> phaseList;
+    std::vector<GLuint> queries; // FRAMES_IN_FLIGHT slots of one query per phase
+    std::vector<double> issuedAt; // when each query began, 0 if it isn't pending
+    std::vector<double> starts;
+    RollingStats frame;
+    double frameStart = 0;
+    size_t frameNumber = 0, slot = 0, dropped = 0;
+    int activeQuery = -1;
+    GetQueryObjectui64vProc getQueryObjectui64v = nullptr;
+
+    // From whichever of EGL and GLFW made the current context, null if neither has it
+    static GetQueryObjectui64vProc loadGetQueryObjectui64v() {
+#ifdef HAVE_EGL
+        if (eglGetCurrentContext() != EGL_NO_CONTEXT) {
+            return (GetQueryObjectui64vProc) eglGetProcAddress("glGetQueryObjectui64v");
+        }
+#endif
+        if (glfwGetCurrentContext() != nullptr) { return (GetQueryObjectui64vProc) glfwGetProcAddress("glGetQueryObjectui64v"); }
+        return nullptr;
+    }
+
+    static double seconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// Times its own lifetime as phase
+class ProfileScope {
+public:
+    ProfileScope(FrameProfiler &profiler, int phase) : profiler(profiler), phase(phase) { profiler.begin(phase); }
+
+    ~ProfileScope() { profiler.end(phase); }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    FrameProfiler &profiler;
+    int phase;
+};
+
+#endif
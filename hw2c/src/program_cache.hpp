@@ -0,0 +1,134 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+//
+//	Linked shader programs saved with glGetProgramBinary and loaded back with
+//	glProgramBinary, so later launches skip compiling and linking the GLSL.
+//	A binary is only good for the driver that made it, so the key hashes the
+//	sources and defines together with GL_VENDOR, GL_RENDERER and GL_VERSION.
+//	Drivers may still refuse a binary, e.g. after an update that kept the
+//	version string. Then the program is built from source and saved again.
+//
+
+static const char PROGRAM_CACHE_MAGIC[4] = {'G', 'L', 'P', 'B'};
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format; // binaryFormat from glGetProgramBinary
+    uint32_t length; // bytes of binary after the header
+};
+
+namespace program_cache_detail {
+
+// FNV-1a, shader sources are small
+static uint64_t hash(const std::string &s, uint64_t h) {
+    for (unsigned char c : s) { h = (h ^ c) * 1099511628211ull; }
+    return (h ^ 0xff) * 1099511628211ull; // separator, so "ab" + "c" and "a" + "bc" differ
+}
+
+static std::string glString(GLenum name) {
+    const GLubyte *s = glGetString(name);
+    return s ? std::string((const char *) s) : std::string();
+}
+
+} // end namespace program_cache_detail
+
+// True if the current driver can hand out program binaries at all
+static bool programBinariesSupported() {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// Key of a program built from these sources and defines by the current driver
+static uint64_t programCacheKey(const std::string &vertexSource, const std::string &fragmentSource,
+                                const std::string &defines) {
+    using namespace program_cache_detail;
+    uint64_t h = 14695981039346656037ull;
+    for (const std::string &s : {vertexSource, fragmentSource, defines, glString(GL_VENDOR), glString(GL_RENDERER),
+                                 glString(GL_VERSION)}) { h = hash(s, h); }
+    return h;
+}
+
+// File the program with key is cached in, within directory
+static std::string programCacheFile(const std::string &directory, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.glpb", (unsigned long long) key);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+// Creates a program linked from the binary cached in file for key. Returns 0 if
+// there is no such binary or the driver rejects it.
+static GLuint loadProgramBinary(const std::string &file, uint64_t key) {
+    FILE *fp = std::fopen(file.c_str(), "rb");
+    if (fp == nullptr) { return 0; }
+    ProgramCacheHeader header;
+    std::vector<char> binary;
+    bool ok = std::fread(&header, sizeof(header), 1, fp) == 1 &&
+              std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == PROGRAM_CACHE_VERSION && header.key == key && header.length > 0;
+    if (ok) {
+        binary.resize(header.length);
+        ok = std::fread(binary.data(), 1, binary.size(), fp) == binary.size();
+    }
+    std::fclose(fp);
+    if (!ok) { return 0; }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Saves a linked program to file, which should have had
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before linking
+static bool saveProgramBinary(GLuint program, const std::string &file, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) { return false; }
+    std::vector<char> binary(length);
+    ProgramCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.format = format;
+    header.length = (uint32_t) length;
+    if (length <= 0) { return false; }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path(), error);
+
+    // Write to a temporary file first so a binary is never half written
+    const std::string temp = file + ".tmp";
+    FILE *fp = std::fopen(temp.c_str(), "wb");
+    if (fp == nullptr) { return false; }
+    bool ok = std::fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              std::fwrite(binary.data(), 1, header.length, fp) == header.length;
+    ok = std::fclose(fp) == 0 && ok;
+    if (ok) {
+        std::filesystem::rename(temp, file, error);
+        ok = !error;
+    }
+    if (!ok) { std::remove(temp.c_str()); }
+    return ok;
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef QUANTIZE_HPP
+#define QUANTIZE_HPP
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "parallel.hpp"
+#include "transform_batch.hpp"
+#include "trimesh.hpp"
+
+//
+//	Packed vertex attributes, 16 bytes per vertex instead of 36:
+//	positions as 16 bit unsigned normalized values within the mesh bounding box
+//	(mapped back by the offset and scale folded into the vertex shader matrices),
+//	normals as GL_INT_2_10_10_10_REV and colors as 8 bit unsigned normalized.
+//	Index buffers shrink to 16 bits when there are few enough vertices.
+//
+
+// Maps a position back from [0,1]^3 as offset + scale * q
+struct PositionQuantization {
+    float offset[3] = {0, 0, 0};
+    float scale[3] = {1, 1, 1};
+
+    // Identity, for unquantized float positions
+    static PositionQuantization none() { return PositionQuantization(); }
+
+    // Fits the bounding box of the vertices
+    static PositionQuantization fit(const Vec3f *vertices, size_t n) {
+        PositionQuantization q;
+        if (n == 0) { return q; }
+        float lo[3], hi[3];
+        boundingBox(vertices[0].data, n, lo, hi);
+        for (int a = 0; a < 3; ++a) {
+            q.offset[a] = lo[a];
+            q.scale[a] = hi[a] > lo[a] ? hi[a] - lo[a] : 1;
+        }
+        return q;
+    }
+
+    void quantize(const Vec3f &p, uint16_t out[4]) const {
+        for (int a = 0; a < 3; ++a) {
+            float t = std::min(std::max((p[a] - offset[a]) / scale[a], 0.f), 1.f);
+            out[a] = (uint16_t) std::lround(t * 65535);
+        }
+        out[3] = 0;
+    }
+
+    Vec3f dequantize(const uint16_t q[4]) const {
+        return Vec3f(offset[0] + scale[0] * (q[0] / 65535.f), offset[1] + scale[1] * (q[1] / 65535.f),
+                     offset[2] + scale[2] * (q[2] / 65535.f));
+    }
+
+    // Largest rounding error along any axis, plus some float error in the shader
+    float errorBound() const {
+        float extent = std::max(scale[0], std::max(scale[1], scale[2]));
+        float reach = std::max(std::fabs(offset[0]), std::max(std::fabs(offset[1]), std::fabs(offset[2]))) + extent;
+        return extent / 65535 / 2 + reach * 4 * FLT_EPSILON;
+    }
+};
+
+// Signed normalized 10 bit x, y, z in GL_INT_2_10_10_10_REV order
+static inline uint32_t packNormal(const Vec3f &n) {
+    uint32_t packed = 0;
+    for (int a = 0; a < 3; ++a) {
+        int c = (int) std::lround(std::min(std::max(n[a], -1.f), 1.f) * 511);
+        packed |= ((uint32_t) c & 0x3ff) << (10 * a);
+    }
+    return packed;
+}
+
+static inline Vec3f unpackNormal(uint32_t packed) {
+    Vec3f n;
+    for (int a = 0; a < 3; ++a) {
+        int c = (int) ((packed >> (10 * a)) & 0x3ff);
+        if (c >= 512) { c -= 1024; }
+        n[a] = std::max(c / 511.f, -1.f);
+    }
+    return n;
+}
+
+// Unsigned normalized 8 bit rgb, alpha is unused
+static inline uint32_t packColor(const Vec3f &c) {
+    uint32_t packed = 0;
+    for (int a = 0; a < 3; ++a) {
+        packed |= (uint32_t) std::lround(std::min(std::max(c[a], 0.f), 1.f) * 255) << (8 * a);
+    }
+    return packed;
+}
+
+// Packed copies of the vertex streams of a mesh, ready for upload
+struct PackedVertices {
+    std::vector<uint16_t> positions; // 4 per vertex, the last is padding
+    std::vector<uint32_t> normals;
+    std::vector<uint32_t> colors;
+
+    static const size_t positionStride = 4 * sizeof(uint16_t);
+
+    size_t bytes() const {
+        return positions.size() * sizeof(uint16_t) + (normals.size() + colors.size()) * sizeof(uint32_t);
+    }
+};
+
+static void packVertices(const MeshView &mesh, const PositionQuantization &q, PackedVertices &packed) {
+    packed.positions.resize(mesh.num_vertices * 4);
+    packed.normals.resize(mesh.num_normals);
+    packed.colors.resize(mesh.num_colors);
+    const size_t blockSize = 1 << 16;
+    const size_t n = std::max(mesh.num_vertices, std::max(mesh.num_normals, mesh.num_colors));
+    ThreadPool::global().parallelForRange(n, blockSize, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < std::min(end, mesh.num_vertices); ++v) { q.quantize(mesh.vertices[v], &packed.positions[v * 4]); }
+        for (size_t v = begin; v < std::min(end, mesh.num_normals); ++v) { packed.normals[v] = packNormal(mesh.normals[v]); }
+        for (size_t v = begin; v < std::min(end, mesh.num_colors); ++v) { packed.colors[v] = packColor(mesh.colors[v]); }
+    });
+}
+
+// Whether indices into numVertices vertices fit in GL_UNSIGNED_SHORT
+static inline bool fitsShortIndices(size_t numVertices) { return numVertices < 65536; }
+
+static std::vector<uint16_t> narrowIndices(const int *indices, size_t n) {
+    std::vector<uint16_t> narrow(n);
+    for (size_t i = 0; i < n; ++i) { narrow[i] = (uint16_t) indices[i]; }
+    return narrow;
+}
+
+// Largest position error and normal angle (degrees) the packing really causes
+static void measureQuantizationError(const MeshView &mesh, const PositionQuantization &q,
+                                     float *positionError, float *normalDegrees) {
+    *positionError = 0;
+    *normalDegrees = 0;
+    for (size_t v = 0; v < mesh.num_vertices; ++v) {
+        uint16_t packed[4];
+        q.quantize(mesh.vertices[v], packed);
+        Vec3f p = q.dequantize(packed);
+        for (int a = 0; a < 3; ++a) { *positionError = std::max(*positionError, std::fabs(p[a] - mesh.vertices[v][a])); }
+    }
+    for (size_t v = 0; v < mesh.num_normals; ++v) {
+        Vec3f n = mesh.normals[v], u = unpackNormal(packNormal(n));
+        double ln = n.len(), lu = u.len();
+        if (ln <= 0 || lu <= 0) { continue; }
+        double cosine = std::min(1.0, std::max(-1.0, n.dot(u) / (ln * lu)));
+        *normalDegrees = std::max(*normalDegrees, (float) (std::acos(cosine) * 180 / M_PI));
+    }
+}
+
+// Prints buffer sizes before and after packing, and the errors it introduces
+static void printQuantizationDetails(const MeshView &mesh, const PositionQuantization &q, size_t numIndices) {
+    float positionError, normalDegrees;
+    measureQuantizationError(mesh, q, &positionError, &normalDegrees);
+    const bool shortIndices = fitsShortIndices(mesh.num_vertices);
+    const size_t before = (mesh.num_vertices + mesh.num_normals + mesh.num_colors) * sizeof(Vec3f) + numIndices * sizeof(int);
+    const size_t after = mesh.num_vertices * PackedVertices::positionStride +
+                         (mesh.num_normals + mesh.num_colors) * sizeof(uint32_t) +
+                         numIndices * (shortIndices ? sizeof(uint16_t) : sizeof(int));
+    std::cout << "Quantized buffers: " << before / 1e6 << " MB -> " << after / 1e6 << " MB ("
+              << (after > 0 ? (float) before / after : 0) << "x), " << (shortIndices ? 16 : 32) << " bit indices" << std::endl;
+    std::cout << "Position error: " << positionError << " (bound " << q.errorBound() << ", mesh extent "
+              << std::max(q.scale[0], std::max(q.scale[1], q.scale[2])) << ")" << std::endl;
+    std::cout << "Normal error: " << normalDegrees << " degrees, color error: " << 0.5f / 255 << std::endl;
+}
+
+#endif
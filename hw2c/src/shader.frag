@@ -1,40 +1,20 @@
 #version 330 core
 
+// Variants define TWO_SIDED, VERTEX_COLORS and NUM_LIGHTS, see shader_variants.hpp
+
 layout(location=0) out vec4 out_fragcolor;
 
-uniform vec3 eye;
+const vec3 eye = vec3(0.0); // lighting is in eye space, where the camera is at the origin
 in vec3 vposition;
-in vec3 vcolor;
 in vec3 vnormal;
 
+#ifdef VERTEX_COLORS
+in vec3 vcolor;
+#else
+uniform vec3 base_color; // the one color of a mesh without vertex colors
+#endif
 
-//
-//	Lights
-//
-struct DirLight {
-	vec3 direction;
-	vec3 intensity;
-};
-
-
-//
-//	Diffuse color
-//
-vec3 diffuse(DirLight light, vec3 color, vec3 N){
-
-	vec3 L = -1.f*normalize(light.direction);
-
-	// Material values
-	vec3 mamb = color;
-	vec3 mdiff = color;
-
-	// Color coeffs
-	vec3 ambient = 0.1f * mamb * light.intensity;
-	float diff = max( dot(N, L), 0.f );
-	vec3 diffuse = diff * mdiff * light.intensity;
-
-	return ( ambient + diffuse );
-}
+#include "lighting.glsl"
 
 void main(){
 
@@ -43,11 +23,17 @@ void main(){
 	light.intensity = vec3(1,1,1);
 
 	vec3 N = normalize(vnormal);
+#ifdef TWO_SIDED
 	vec3 V = normalize(eye-vposition);
-
 	if( dot(N,V) < 0.0 ){ N *= -1.0; } // draw two-sided
-	vec3 result = diffuse( light, vcolor, N );
+#endif
+
+#ifdef VERTEX_COLORS
+	vec3 color = vcolor;
+#else
+	vec3 color = base_color;
+#endif
+	vec3 result = diffuse( light, color, N );
+	for( int i = 0; i < NUM_LIGHTS-1; ++i ){ result += diffuse( fill_lights[i], color, N ); }
 	out_fragcolor = vec4( result, 1.0 );
-} 
-
-
+}
@@ -22,9 +22,26 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP 1
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <sstream>
-#include <unordered_map> // requires C++11
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "program_cache.hpp"
+#include "trace.hpp"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 //
 //	Shader utility class for managing vert/frag shaders.
@@ -42,46 +59,191 @@
 //		myshader.disable();
 //	}
 //
+//	Active uniforms and attributes are listed once, after linking. In a
+//	render loop use a handle looked up beforehand, or a name hashed at
+//	compile time, so no string is built or hashed per call:
+//	int color = myshader.uniform_handle("color");
+//	glUniform3f( myshader.uniform(color), 1.f, 0.f, 0.f );
+//	glUniform3f( myshader.uniform(SHADER_ID("color")), 1.f, 0.f, 0.f );
+//
+//	Programs can also be built without waiting for them. init_from_*_async
+//	hands the sources over and returns, the driver compiles them on its own
+//	threads if it has KHR_parallel_shader_compile, otherwise a ShaderWorker
+//	does it on a thread with a shared context. Nothing asks for the compile
+//	or link status until ready() sees the build done, or enable() needs it:
+//	myshader.init_from_files_async( "myshader.vert", "myshader.frag", &worker );
+//	while( !myshader.ready() ){ < draw a placeholder frame > }
+//
+
+namespace mcl {
+
+// FNV-1a hash of a uniform or attribute name
+constexpr uint32_t shader_name_hash( const char *name, uint32_t hash=2166136261u ){
+	return *name ? shader_name_hash(name+1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+// A name hashed at compile time, see SHADER_ID
+struct ShaderId {
+	uint32_t hash;
+	constexpr explicit ShaderId( uint32_t h ) : hash(h) {}
+};
+
+} // end namespace mcl
+
+// Id of a string literal name, hashed by the compiler
+#define SHADER_ID(name) mcl::ShaderId(std::integral_constant<uint32_t, mcl::shader_name_hash(name)>::value)
 
 namespace mcl {
 
+// Compiles and links programs on a thread of its own, for drivers that
+// can't do it in the background themselves. The thread needs a context
+// that shares objects with the rendering one, made current by start.
+class ShaderWorker {
+public:
+	// Use the worker even if the driver has KHR_parallel_shader_compile
+	bool preferred = false;
+
+	ShaderWorker() = default;
+	ShaderWorker( const ShaderWorker& ) = delete;
+	ShaderWorker &operator=( const ShaderWorker& ) = delete;
+
+	~ShaderWorker(){ stop(); }
+
+	// Starts the thread, which calls make_current first and release before it ends
+	inline void start( std::function<void()> make_current, std::function<void()> release = nullptr );
+
+	// Runs the jobs still queued, then ends the thread
+	inline void stop();
+
+	inline bool running() const { return thread.joinable(); }
+
+	// Queues a job for the thread, jobs run in the order submitted
+	inline void submit( std::function<void()> job );
+
+private:
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque< std::function<void()> > jobs;
+	bool stopping = false;
+};
+
 class Shader {
 public:
 	Shader() : program_id(0) {}
 
-	~Shader(){ glDeleteProgram(program_id); }
+	~Shader(){ wait_for_worker(); glDeleteProgram(program_id); }
 
 	// Init the shader from files (must create OpenGL context first!)
-	inline void init_from_files( std::string vertex_file, std::string frag_file );
+	inline void init_from_files( std::string vertex_file, std::string frag_file ){ init_from_files_async(vertex_file, frag_file); finish(); }
 
 	// Init the shader from strings (must create OpenGL context first!)
-	inline void init_from_strings( std::string vertex_source, std::string frag_source ){ init(vertex_source, frag_source); }
+	inline void init_from_strings( std::string vertex_source, std::string frag_source ){ start(vertex_source, frag_source, nullptr); finish(); }
+
+	// Start building the shader and return without waiting for it. The driver
+	// compiles in the background if it can, else worker does if given and started.
+	// With neither the build is done right away. Errors throw from ready() or enable().
+	inline void init_from_files_async( std::string vertex_file, std::string frag_file, ShaderWorker *worker=nullptr );
+	inline void init_from_strings_async( std::string vertex_source, std::string frag_source, ShaderWorker *worker=nullptr ){ start(vertex_source, frag_source, worker); }
+
+	// True once the program is built and can be used, never blocks while it compiles
+	inline bool ready();
+
+	// True if the driver builds programs in the background, GL_KHR_parallel_shader_compile
+	inline static bool parallel_compile_supported();
+
+	// Keep linked programs as binaries in directory, so an init with the same
+	// sources on the same driver loads one instead of compiling. Call before init_from_*.
+	inline void use_binary_cache( std::string directory ){ binary_cache = directory; }
 
-	// Be sure to initialize the shader before enabling it
+	// True if the last init loaded the program from the binary cache
+	inline bool from_binary_cache() const { return loaded_binary; }
+
+	// Be sure to initialize the shader before enabling it, waits for an async build
 	inline void enable();
 
 	// Not really needed, but nice for readability
 	inline void disable(){ glUseProgram(0); }
 
 	// Returns the bound location of a named attribute
-	inline GLuint attribute( const std::string name );
+	inline GLuint attribute( const std::string &name ) const { return attribute_list[checked(attribute_handle(name), "attribute", name)].location; }
 
 	// Returns the bound location of a named uniform
-	inline GLuint uniform( const std::string name );
+	inline GLuint uniform( const std::string &name ) const { return uniform_list[checked(uniform_handle(name), "uniform", name)].location; }
+
+	// Handle of a named active uniform or attribute, -1 if the program has none.
+	// Handles are indices into flat arrays and stay valid until the next init.
+	inline int uniform_handle( const std::string &name ) const { return find(uniform_list, name); }
+	inline int attribute_handle( const std::string &name ) const { return find(attribute_list, name); }
+
+	// Location from a handle, an array index
+	inline GLuint uniform( int handle ) const { return uniform_list[handle].location; }
+	inline GLuint attribute( int handle ) const { return attribute_list[handle].location; }
+
+	// Location from a name hashed at compile time, e.g. uniform(SHADER_ID("color"))
+	inline GLuint uniform( ShaderId id ) const { return uniform_list[checked(find(uniform_list, id.hash), "uniform", id)].location; }
+	inline GLuint attribute( ShaderId id ) const { return attribute_list[checked(find(attribute_list, id.hash), "attribute", id)].location; }
+
+	// Active uniform or attribute as reflected after linking, uniforms in blocks are left out
+	struct Variable {
+		std::string name; // without the [0] of arrays
+		uint32_t hash; // shader_name_hash of name
+		GLint location;
+		GLenum type; // e.g. GL_FLOAT_MAT4
+		GLint size; // array length, 1 if not an array
+	};
+
+	// Sorted by hash, a handle is an index
+	const std::vector<Variable> &uniforms() const { return uniform_list; }
+	const std::vector<Variable> &attributes() const { return attribute_list; }
+
+	// Reads a named uniform block from the buffer bound at binding, so
+	// programs that share a block can share its buffer too. Waits for an async build.
+	inline void uniform_block( const std::string name, GLuint binding );
  
 private:
 	GLuint program_id;
 	GLuint vertex_id;
 	GLuint fragment_id;
 
-	std::unordered_map<std::string, GLuint> attributes;
-	std::unordered_map<std::string, GLuint> uniforms;
+	std::vector<Variable> attribute_list;
+	std::vector<Variable> uniform_list;
+
+	std::string binary_cache; // directory, empty to always compile
+	bool loaded_binary = false;
+
+	// Where the build started by start is
+	enum class Build { finished, linked, in_driver, on_worker };
+	Build build = Build::finished;
+	std::shared_ptr< std::atomic<bool> > worker_done; // set by the worker job once linked
+	uint64_t cache_key = 0; // to save the binary under once finished, if cache_file isn't empty
+	std::string cache_file;
+
+	// Loads the program from the binary cache, or compiles and links it
+	// (or has worker do that) without checking the outcome
+	inline void start( std::string vertex_source, std::string frag_source, ShaderWorker *worker );
+
+	// Checks the compile and link status of the build, then reflects and caches the program
+	inline void finish();
 
-	// Initialize the shader, called by init_from_*
-	inline void init( std::string vertex_source, std::string frag_source );
+	// Blocks until a job on the worker is done
+	inline void wait_for_worker();
 
-	// Compiles the shader, called by init
-	inline GLuint compile( std::string shaderSource, GLenum type );
+	// Lists the active uniforms and attributes, called by finish after linking
+	inline void reflect();
+
+	// Index of the variable with a hash or name, -1 if there is none
+	inline static int find( const std::vector<Variable> &list, uint32_t hash );
+	inline static int find( const std::vector<Variable> &list, const std::string &name );
+
+	// Throws if handle is -1
+	inline static int checked( int handle, const char *kind, const std::string &name );
+	inline static int checked( int handle, const char *kind, ShaderId id ){ return handle >= 0 ? handle : checked(handle, kind, "hash "+std::to_string(id.hash)); }
+
+	// Compiles both shaders and links them into program, not checking any status.
+	// Called by start, or on the worker thread.
+	inline static void compile_and_link( GLuint program, GLuint vertex, GLuint fragment,
+		const std::string &vertex_source, const std::string &frag_source );
 
 }; // end of shader
 
@@ -90,52 +252,172 @@ private:
 //	Implementation
 //
 
-GLuint Shader::compile( std::string source, GLenum type ){
+void ShaderWorker::start( std::function<void()> make_current, std::function<void()> release ){
+	stop();
+	stopping = false;
+	thread = std::thread([this, make_current, release](){
+		TRACE_THREAD_NAME( "shader worker" );
+		make_current();
+		for(;;){
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this](){ return stopping || !jobs.empty(); });
+				if( jobs.empty() ){ break; }
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+		if( release ){ release(); }
+	});
+}
+
 
-	// Generate a shader id
-	// Note: Shader id will be non-zero if successfully created.
-	GLuint shaderId = glCreateShader(type);
-	if( shaderId == 0 ){ throw std::runtime_error("\n**glCreateShader Error"); }
+void ShaderWorker::stop(){
+	if( !thread.joinable() ){ return; }
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
 
-	// Attach the GLSL source code and compile the shader
-	const char *shaderchar = source.c_str();
-	glShaderSource(shaderId, 1, &shaderchar, NULL);
-	glCompileShader(shaderId);
 
-	// Check the compilation status and throw a runtime_error if shader compilation failed
-	GLint shaderStatus;
-	glGetShaderiv(shaderId, GL_COMPILE_STATUS, &shaderStatus);
-	if( shaderStatus == GL_FALSE ){ throw std::runtime_error("\n**glCompileShader Error"); }
+void ShaderWorker::submit( std::function<void()> job ){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+
+bool Shader::parallel_compile_supported(){
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for( GLint i = 0; i < count; ++i ){
+		const char *name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if( name && (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0) ){ return true; }
+	}
+	return false;
+}
 
-	return shaderId;
+
+void Shader::compile_and_link( GLuint program, GLuint vertex, GLuint fragment,
+	const std::string &vertex_source, const std::string &frag_source ){
+
+	TRACE_SCOPE( "Shader::compile_and_link" );
+
+	// Attach the GLSL source code and compile the shaders
+	const char *shaderchar = vertex_source.c_str();
+	glShaderSource(vertex, 1, &shaderchar, NULL);
+	glCompileShader(vertex);
+	shaderchar = frag_source.c_str();
+	glShaderSource(fragment, 1, &shaderchar, NULL);
+	glCompileShader(fragment);
+
+	// Attach and link the shader program
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
 }
 
 
-void Shader::init(std::string vertex_source, std::string frag_source){
+void Shader::start( std::string vertex_source, std::string frag_source, ShaderWorker *worker ){
 
-	// Create the resource
+	TRACE_SCOPE( "Shader::start" );
+
+	// A build still running on the worker must not touch the program once it's replaced
+	wait_for_worker();
+	build = Build::finished;
+
+	// Load the program from the binary cache if it has one the driver takes
+	loaded_binary = false;
+	const bool use_cache = !binary_cache.empty() && programBinariesSupported();
+	cache_key = use_cache ? programCacheKey(vertex_source, frag_source, "") : 0;
+	cache_file = use_cache ? programCacheFile(binary_cache, cache_key) : "";
+	if( use_cache && (program_id = loadProgramBinary(cache_file, cache_key)) != 0 ){
+		loaded_binary = true;
+		cache_file.clear();
+		reflect();
+		return;
+	}
+
+	// Create the resources
+	// Note: Ids will be non-zero if successfully created.
 	program_id = glCreateProgram();
 	if( program_id == 0 ){ throw std::runtime_error("\n**glCreateProgram Error"); }
-	glUseProgram(program_id);
+	if( use_cache ){ glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); }
+	vertex_id = glCreateShader(GL_VERTEX_SHADER);
+	fragment_id = glCreateShader(GL_FRAGMENT_SHADER);
+	if( vertex_id == 0 || fragment_id == 0 ){ throw std::runtime_error("\n**glCreateShader Error"); }
+
+	// The worker's context sees the objects once they exist, and this one sees
+	// the linked program once the worker has finished its commands
+	const bool parallel = parallel_compile_supported();
+	if( worker && worker->running() && (worker->preferred || !parallel) ){
+		std::shared_ptr< std::atomic<bool> > done = worker_done = std::make_shared< std::atomic<bool> >(false);
+		GLuint program = program_id, vertex = vertex_id, fragment = fragment_id;
+		worker->submit([=](){
+			compile_and_link(program, vertex, fragment, vertex_source, frag_source);
+			glFinish();
+			done->store(true, std::memory_order_release);
+		});
+		build = Build::on_worker;
+		return;
+	}
 
-	// Compile the shaders and return their id values
-	vertex_id = compile(vertex_source, GL_VERTEX_SHADER);
-	fragment_id = compile(frag_source, GL_FRAGMENT_SHADER);
+	// Returns at once when the driver compiles in parallel, the status queries in finish would wait
+	compile_and_link(program_id, vertex_id, fragment_id, vertex_source, frag_source);
+	build = parallel ? Build::in_driver : Build::linked;
+}
 
-	// Attach and link the shader program
-	glAttachShader(program_id, vertex_id);
-	glAttachShader(program_id, fragment_id);
-	glLinkProgram(program_id);
+
+bool Shader::ready(){
+	if( build == Build::in_driver ){
+		GLint done = GL_FALSE;
+		glGetProgramiv(program_id, GL_COMPLETION_STATUS_KHR, &done);
+		if( done == GL_FALSE ){ return false; }
+	}
+	else if( build == Build::on_worker && !worker_done->load(std::memory_order_acquire) ){ return false; }
+	finish();
+	return program_id != 0;
+}
+
+
+void Shader::wait_for_worker(){
+	if( build != Build::on_worker ){ return; }
+	while( !worker_done->load(std::memory_order_acquire) ){ std::this_thread::yield(); }
+}
+
+
+void Shader::finish(){
+
+	if( build == Build::finished ){ return; }
+	TRACE_SCOPE( "Shader::finish" );
+	wait_for_worker();
+	build = Build::finished;
+	worker_done.reset();
+
+	// Check the compilation status and throw a runtime_error if shader compilation failed
+	GLint shaderStatus = GL_FALSE;
+	glGetShaderiv(vertex_id, GL_COMPILE_STATUS, &shaderStatus);
+	if( shaderStatus == GL_TRUE ){ glGetShaderiv(fragment_id, GL_COMPILE_STATUS, &shaderStatus); }
 
 	// Once the shader program has the shaders attached and linked, the shaders are no longer required.
 	// If the linking failed, then we're going to abort anyway so we still detach the shaders.
 	glDetachShader(program_id, vertex_id);
 	glDetachShader(program_id, fragment_id);
+	if( shaderStatus == GL_FALSE ){ throw std::runtime_error("\n**glCompileShader Error"); }
 
 	// Check the program link status and throw a runtime_error if program linkage failed.
 	GLint programLinkSuccess = GL_FALSE;
 	glGetProgramiv(program_id, GL_LINK_STATUS, &programLinkSuccess);
 	if( programLinkSuccess != GL_TRUE ){ throw std::runtime_error("\n**Shader Error: Problem with link"); }
+	reflect();
+	if( !cache_file.empty() ){ saveProgramBinary(program_id, cache_file, cache_key); }
 
 	// Check the validation status and throw a runtime_error if program validation failed.
 	// Does NOT work with corearb headers???
@@ -143,12 +425,10 @@ void Shader::init(std::string vertex_source, std::string frag_source){
 //	GLint programValidatationStatus;
 //	glGetProgramiv(program_id, GL_VALIDATE_STATUS, &programValidatationStatus);
 //	if( programValidatationStatus != GL_TRUE ){ throw std::runtime_error("\n**Shader Error: Problem with validation"); }
-
-	glUseProgram(0);
 }
 
 
-void Shader::init_from_files( std::string vertex_file, std::string frag_file ){
+void Shader::init_from_files_async( std::string vertex_file, std::string frag_file, ShaderWorker *worker ){
 
 	std::string vert_string, frag_string;
 
@@ -162,35 +442,71 @@ void Shader::init_from_files( std::string vertex_file, std::string frag_file ){
 	if( frag_in ){ frag_string = (std::string((std::istreambuf_iterator<char>(frag_in)), std::istreambuf_iterator<char>())); }
 	else{ throw std::runtime_error("\n**Shader Error: failed to load \""+frag_file+"\"" ); }
 
-	init( vert_string, frag_string );
+	start( vert_string, frag_string, worker );
 }
 
 
 void Shader::enable(){
+	finish();
 	if( program_id!=0 ){ glUseProgram(program_id); }
 	else{ throw std::runtime_error("\n**Shader Error: Can't enable, not initialized"); }
 }
 
 
-GLuint Shader::attribute(const std::string name){
-
-	// Add the attribute to the map table if it doesn't already exist
-	if( attributes.count(name)==0 ){
-		attributes[name] = glGetAttribLocation( program_id, name.c_str() );
-		if( attributes[name] == -1 ){ throw std::runtime_error("\n**Shader Error: bad attribute ("+name+")"); }
+void Shader::reflect(){
+
+	GLint count = 0, max_length = 0;
+	for( int list = 0; list < 2; ++list ){
+		const bool is_uniform = list == 0;
+		std::vector<Variable> &variables = is_uniform ? uniform_list : attribute_list;
+		variables.clear();
+		glGetProgramiv( program_id, is_uniform ? GL_ACTIVE_UNIFORMS : GL_ACTIVE_ATTRIBUTES, &count );
+		glGetProgramiv( program_id, is_uniform ? GL_ACTIVE_UNIFORM_MAX_LENGTH : GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length );
+		std::vector<char> name( std::max(max_length, 1) );
+		for( GLint i = 0; i < count; ++i ){
+			Variable v;
+			GLsizei length = 0;
+			if( is_uniform ){ glGetActiveUniform( program_id, i, (GLsizei)name.size(), &length, &v.size, &v.type, name.data() ); }
+			else{ glGetActiveAttrib( program_id, i, (GLsizei)name.size(), &length, &v.size, &v.type, name.data() ); }
+			v.name.assign( name.data(), length );
+			if( v.name.size() > 3 && v.name.compare(v.name.size()-3, 3, "[0]") == 0 ){ v.name.resize(v.name.size()-3); }
+			v.hash = shader_name_hash( v.name.c_str() );
+			v.location = is_uniform ? glGetUniformLocation( program_id, v.name.c_str() ) : glGetAttribLocation( program_id, v.name.c_str() );
+			if( v.location != -1 ){ variables.push_back( v ); } // members of uniform blocks have none
+		}
+		std::sort( variables.begin(), variables.end(), []( const Variable &a, const Variable &b ){ return a.hash < b.hash; } );
+		for( size_t k = 1; k < variables.size(); ++k ){
+			if( variables[k].hash == variables[k-1].hash ){
+				throw std::runtime_error("\n**Shader Error: "+variables[k-1].name+" and "+variables[k].name+" have the same hash, rename one");
+			}
+		}
 	}
-	return attributes[name];
 }
 
 
-GLuint Shader::uniform(const std::string name){
+int Shader::find( const std::vector<Variable> &list, uint32_t hash ){
+	auto it = std::lower_bound( list.begin(), list.end(), hash, []( const Variable &v, uint32_t h ){ return v.hash < h; } );
+	return it != list.end() && it->hash == hash ? (int)(it - list.begin()) : -1;
+}
 
-	// Add the uniform to the map table if it doesn't already exist
-	if( uniforms.count(name)==0 ){ 
-		uniforms[name] = glGetUniformLocation( program_id, name.c_str() );
-		if( uniforms[name] == -1 ){ throw std::runtime_error("\n**Shader Error: bad uniform ("+name+")"); }
-	}
-	return uniforms[name];
+
+int Shader::find( const std::vector<Variable> &list, const std::string &name ){
+	int handle = find( list, shader_name_hash(name.c_str()) );
+	return handle >= 0 && list[handle].name == name ? handle : -1;
+}
+
+
+int Shader::checked( int handle, const char *kind, const std::string &name ){
+	if( handle < 0 ){ throw std::runtime_error(std::string("\n**Shader Error: bad ")+kind+" ("+name+")"); }
+	return handle;
+}
+
+
+void Shader::uniform_block(const std::string name, GLuint binding){
+	finish();
+	GLuint index = glGetUniformBlockIndex( program_id, name.c_str() );
+	if( index == GL_INVALID_INDEX ){ throw std::runtime_error("\n**Shader Error: bad uniform block ("+name+")"); }
+	glUniformBlockBinding( program_id, index, binding );
 }
 
 
@@ -1,22 +1,27 @@
 #version 330 core
 
+// Variants define TWO_SIDED, VERTEX_COLORS and NUM_LIGHTS, see shader_variants.hpp
+
 layout(location=0) in vec3 in_position;
-layout(location=1) in vec3 in_color;
 layout(location=2) in vec3 in_normal;
 
 out vec3 vposition;
-out vec3 vcolor;
 out vec3 vnormal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef VERTEX_COLORS
+layout(location=1) in vec3 in_color;
+out vec3 vcolor;
+#endif
+
+#include "frame.glsl"
 
 void main()
 {
-    vec4 pos = projection * view *  model *  vec4(in_position, 1.0);
+    vec4 position = vec4(in_position, 1.0);
+#ifdef VERTEX_COLORS
     vcolor = in_color;
-    vnormal = in_normal;
-    vposition = vec3(pos);
-    gl_Position = pos;
+#endif
+    vnormal = normal_matrix * in_normal;
+    vposition = vec3(mv * position); // eye space, the eye is at the origin
+    gl_Position = mvp * position;
 }
@@ -0,0 +1,232 @@
+#ifndef SHADER_VARIANTS_HPP
+#define SHADER_VARIANTS_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "embedded_shaders.hpp"
+#include "shader.hpp"
+
+//
+//	Variants of one vertex and fragment shader pair, built from the same
+//	files with a different set of #defines each. A variant key is a bitmask
+//	of the features below, so a draw picks the program that has exactly what
+//	its material uses and the GPU never branches on, or computes, the rest.
+//	The files are run through a small preprocessor first that pastes in
+//	#include "file" lines, which GLSL has no use for on its own. Files come
+//	from the copies embedded at build time unless a directory is given. A registry
+//	builds the variants a scene needs when it loads, all at once and in the
+//	background (see Shader::init_from_strings_async), before the first draw.
+//
+
+// Variant key bits, each one a #define in the shaders
+const uint32_t SHADER_TWO_SIDED = 1u << 0;     // TWO_SIDED, light back faces as if they faced the eye
+const uint32_t SHADER_VERTEX_COLORS = 1u << 1; // VERTEX_COLORS, per vertex colors, else the base_color uniform
+
+// Bits 2 and 3 hold the number of lights less one, NUM_LIGHTS
+const int SHADER_LIGHTS_SHIFT = 2;
+const uint32_t SHADER_LIGHTS_MASK = 3u << SHADER_LIGHTS_SHIFT;
+const int SHADER_MAX_LIGHTS = 4;
+
+// Number of variant keys, every combination of the bits above
+const uint32_t SHADER_NUM_VARIANTS = 1u << 4;
+
+// Key with features and lights lights (1 to SHADER_MAX_LIGHTS)
+static uint32_t shaderVariant(uint32_t features, int lights) {
+    lights = lights < 1 ? 1 : (lights > SHADER_MAX_LIGHTS ? SHADER_MAX_LIGHTS : lights);
+    return (features & ~SHADER_LIGHTS_MASK) | ((uint32_t) (lights - 1) << SHADER_LIGHTS_SHIFT);
+}
+
+static int shaderVariantLights(uint32_t key) { return (int) ((key & SHADER_LIGHTS_MASK) >> SHADER_LIGHTS_SHIFT) + 1; }
+
+// The #define lines of key
+static std::string shaderVariantDefines(uint32_t key) {
+    std::string defines;
+    if (key & SHADER_TWO_SIDED) { defines += "#define TWO_SIDED\n"; }
+    if (key & SHADER_VERTEX_COLORS) { defines += "#define VERTEX_COLORS\n"; }
+    defines += "#define NUM_LIGHTS " + std::to_string(shaderVariantLights(key)) + "\n";
+    return defines;
+}
+
+// Readable name of key, e.g. "two-sided, vertex colors, 2 lights"
+static std::string shaderVariantName(uint32_t key) {
+    const int lights = shaderVariantLights(key);
+    return std::string(key & SHADER_TWO_SIDED ? "two-sided" : "one-sided") +
+           (key & SHADER_VERTEX_COLORS ? ", vertex colors, " : ", base color, ") + std::to_string(lights) +
+           (lights == 1 ? " light" : " lights");
+}
+
+// Text of the shader file name, read from directory, or embedded in the
+// binary at build time if directory is empty. Throws if there is no such file.
+static std::string readShaderFile(const std::string &name, const std::string &directory) {
+    if (directory.empty()) {
+        const EmbeddedShader *shader = findEmbeddedShader(name.c_str());
+        if (shader == nullptr) { throw std::runtime_error("\n**Shader Error: \"" + name + "\" is not embedded"); }
+        return std::string(shader->source, shader->length);
+    }
+    const std::filesystem::path file = std::filesystem::path(directory) / name;
+    std::ifstream in(file, std::ios::in | std::ios::binary);
+    if (!in) { throw std::runtime_error("\n**Shader Error: failed to load \"" + file.string() + "\""); }
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+namespace shader_variants_detail {
+
+// Appends file to out, with each #include "name" line replaced by the file
+// name next to it. #line directives keep the compiler's messages pointing at
+// the right line, files holds the name of each source string number.
+static void expand(const std::filesystem::path &file, const std::string &directory, std::vector<std::string> &files,
+                   std::string &out, int depth) {
+    if (depth > 16) { throw std::runtime_error("\n**Shader Error: includes nested too deep in \"" + file.string() + "\""); }
+    std::istringstream in(readShaderFile(file.generic_string(), directory));
+    const int index = (int) files.size();
+    files.push_back(file.generic_string());
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        size_t p = line.find_first_not_of(" \t");
+        if (p == std::string::npos || line.compare(p, 8, "#include") != 0) {
+            out += line;
+            out += '\n';
+            continue;
+        }
+        const size_t open = line.find('"', p + 8), close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos) {
+            throw std::runtime_error("\n**Shader Error: bad #include in \"" + file.string() + "\" line " + std::to_string(number));
+        }
+        out += "#line 1 " + std::to_string(files.size()) + "\n";
+        expand((file.parent_path() / line.substr(open + 1, close - open - 1)).lexically_normal(), directory, files, out,
+               depth + 1);
+        out += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+    }
+}
+
+} // end namespace shader_variants_detail
+
+// Source of file with its includes pasted in, from directory or the embedded
+// copies (see readShaderFile). files, if given, gets the name of each source
+// string number the #line directives use, the file itself is 0.
+static std::string preprocessShader(const std::string &file, const std::string &directory = "",
+                                    std::vector<std::string> *files = nullptr) {
+    std::vector<std::string> paths;
+    std::string out;
+    shader_variants_detail::expand(file, directory, paths, out, 0);
+    if (files) { *files = paths; }
+    return out;
+}
+
+// source with defines after its #version line, which has to stay the first
+static std::string addShaderDefines(const std::string &source, const std::string &defines) {
+    if (source.compare(0, 8, "#version") != 0) { return defines + "#line 1 0\n" + source; }
+    const size_t end = source.find('\n');
+    if (end == std::string::npos) { return source + "\n" + defines; }
+    return source.substr(0, end + 1) + defines + "#line 2 0\n" + source.substr(end + 1);
+}
+
+class ShaderVariants {
+public:
+    // Runs once on each program as it becomes ready, before it draws, e.g. to bind its uniform blocks
+    std::function<void(mcl::Shader &)> onReady;
+
+    // Preprocesses the two files, from shaderDirectory or embedded if it is
+    // empty, and a variant adds its defines to them. Programs are cached as
+    // binaries in cacheDirectory, unless it is empty.
+    void init(const std::string &vertexFile, const std::string &fragmentFile, const std::string &shaderDirectory = "",
+              const std::string &cacheDirectory = "") {
+        vertexSource = preprocessShader(vertexFile, shaderDirectory);
+        fragmentSource = preprocessShader(fragmentFile, shaderDirectory);
+        cache = cacheDirectory;
+        variants.clear();
+    }
+
+    // Threads to build on when the driver can't build in the background, in turn
+    void setWorkers(const std::vector<mcl::ShaderWorker *> &shaderWorkers) { workers = shaderWorkers; }
+
+    // Starts building the variants, in this order, that aren't built or being built
+    void precompile(const std::vector<uint32_t> &keys) {
+        for (uint32_t key : keys) { find(key); }
+    }
+
+    // True if the variant is built and set up, never blocks
+    bool ready(uint32_t key) {
+        Variant &v = find(key);
+        if (!v.setUp) {
+            if (!v.shader->ready()) { return false; }
+            setUp(key, v);
+        }
+        return true;
+    }
+
+    // True if all variants started so far are ready
+    bool allReady() {
+        bool all = true;
+        for (auto &entry : variants) { all = ready(entry.first) && all; }
+        return all;
+    }
+
+    // Enables the variant for a draw. One that wasn't precompiled is built
+    // now, and one still building is waited for.
+    mcl::Shader &use(uint32_t key) {
+        Variant &v = find(key);
+        if (!v.setUp) { setUp(key, v); }
+        if (key != current) {
+            v.shader->enable();
+            current = key;
+        }
+        return *v.shader;
+    }
+
+    // Forgets which variant is enabled, after something else used a program,
+    // so the next use enables its variant again
+    void invalidate() { current = ~0u; }
+
+    size_t size() const { return variants.size(); }
+
+    // Whether the variant came from the binary cache, once ready
+    bool fromBinaryCache(uint32_t key) {
+        return find(key).shader->from_binary_cache();
+    }
+
+private:
+    struct Variant {
+        std::unique_ptr<mcl::Shader> shader;
+        bool setUp = false;
+    };
+
+    std::string vertexSource, fragmentSource, cache;
+    std::map<uint32_t, Variant> variants;
+    std::vector<mcl::ShaderWorker *> workers;
+    size_t nextWorker = 0;
+    uint32_t current = ~0u; // enabled variant, so switching back and forth costs nothing
+
+    // The variant for key, started if it wasn't
+    Variant &find(uint32_t key) {
+        auto it = variants.find(key);
+        if (it != variants.end()) { return it->second; }
+        Variant &v = variants[key];
+        v.shader.reset(new mcl::Shader());
+        if (!cache.empty()) { v.shader->use_binary_cache(cache); }
+        const std::string defines = shaderVariantDefines(key);
+        mcl::ShaderWorker *worker = workers.empty() ? nullptr : workers[nextWorker++ % workers.size()];
+        v.shader->init_from_strings_async(addShaderDefines(vertexSource, defines), addShaderDefines(fragmentSource, defines),
+                                          worker);
+        return v;
+    }
+
+    // Runs onReady with the variant enabled, waiting for it to be built
+    void setUp(uint32_t key, Variant &v) {
+        v.shader->enable();
+        current = key;
+        if (onReady) { onReady(*v.shader); }
+        v.setUp = true;
+    }
+};
+
+#endif
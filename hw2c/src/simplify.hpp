@@ -0,0 +1,248 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "trimesh.hpp"
+
+//
+//	Edge collapse simplification with quadric error metrics (Garland and Heckbert,
+//	"Surface Simplification Using Quadric Error Metrics", 1997).
+//	Vertices only ever collapse onto existing vertices, so a simplified mesh is
+//	just a new index buffer over the original vertex arrays. Collapses are done in
+//	passes: every pass sorts candidate edges by cost and applies the cheapest ones
+//	whose neighbourhoods don't overlap, which keeps each pass O(n log n).
+//
+
+// Sum of squared distances to a set of planes, weighted by triangle area
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0, w = 0;
+
+    // Plane n.x + d = 0 with unit normal n
+    static Quadric plane(double nx, double ny, double nz, double d, double weight) {
+        Quadric q;
+        q.a00 = nx * nx * weight;
+        q.a01 = nx * ny * weight;
+        q.a02 = nx * nz * weight;
+        q.a11 = ny * ny * weight;
+        q.a12 = ny * nz * weight;
+        q.a22 = nz * nz * weight;
+        q.b0 = nx * d * weight;
+        q.b1 = ny * d * weight;
+        q.b2 = nz * d * weight;
+        q.c = d * d * weight;
+        q.w = weight;
+        return q;
+    }
+
+    Quadric &operator+=(const Quadric &q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c; w += q.w;
+        return *this;
+    }
+
+    // Mean squared distance of p to the planes
+    double error(const Vec3f &p) const {
+        const double x = p[0], y = p[1], z = p[2];
+        double r = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                   2 * (b0 * x + b1 * y + b2 * z) + c;
+        return w > 0 ? std::fabs(r) / w : 0;
+    }
+};
+
+namespace simplify_detail {
+
+struct PositionKey {
+    uint32_t x, y, z;
+
+    bool operator==(const PositionKey &k) const { return x == k.x && y == k.y && z == k.z; }
+};
+
+struct PositionHash {
+    size_t operator()(const PositionKey &k) const {
+        return (size_t) ((k.x * 0x9E3779B97F4A7C15ull) ^ (k.y * 0xC2B2AE3D27D4EB4Full) ^ (k.z * 0x165667B19E3779F9ull));
+    }
+};
+
+struct Collapse {
+    double cost;
+    int from, to;
+
+    bool operator<(const Collapse &c) const { return cost < c.cost || (cost == c.cost && from < c.from); }
+};
+
+static inline Vec3f triangleNormal(const Vec3f &a, const Vec3f &b, const Vec3f &c) {
+    return (b - a).cross(c - a);
+}
+
+} // end namespace simplify_detail
+
+// Simplifies faces (indices into positions) to about targetFaces triangles.
+// Vertices on open or non-manifold edges never move, so pieces of a mesh
+// simplified separately still fit together. Returns the new triangles and
+// sets *error to the largest RMS distance of a collapsed vertex to its planes.
+static std::vector<Vec3i> simplifyFaces(const Vec3f *positions, const std::vector<Vec3i> &faces,
+                                        size_t targetFaces, float *error) {
+    using namespace simplify_detail;
+    *error = 0;
+    if (faces.size() <= targetFaces) { return faces; }
+
+    // Local vertex ids, and a canonical one per distinct position so that
+    // vertices split only by their normal or color collapse together
+    std::unordered_map<int, int> local;
+    std::unordered_map<PositionKey, int, PositionHash> byPosition;
+    std::vector<int> global, weld;
+    std::vector<Vec3i> tris(faces.size());
+    local.reserve(faces.size());
+    byPosition.reserve(faces.size());
+    for (size_t t = 0; t < faces.size(); ++t) {
+        for (int k = 0; k < 3; ++k) {
+            auto inserted = local.emplace(faces[t][k], (int) global.size());
+            if (inserted.second) {
+                const Vec3f &p = positions[faces[t][k]];
+                PositionKey key;
+                std::memcpy(&key, &p, sizeof(key));
+                auto welded = byPosition.emplace(key, (int) global.size());
+                global.push_back(faces[t][k]);
+                weld.push_back(welded.first->second);
+            }
+            tris[t][k] = inserted.first->second;
+        }
+    }
+    const int nv = global.size();
+    auto pos = [&](int v) -> const Vec3f & { return positions[global[v]]; };
+
+    // Quadrics of the planes around each position
+    std::vector<Quadric> quadrics(nv);
+    for (const Vec3i &t : tris) {
+        const Vec3f &p0 = pos(weld[t[0]]);
+        Vec3f n = triangleNormal(p0, pos(weld[t[1]]), pos(weld[t[2]]));
+        double len = n.len();
+        if (len <= 0) { continue; }
+        double nx = n[0] / len, ny = n[1] / len, nz = n[2] / len;
+        Quadric q = Quadric::plane(nx, ny, nz, -(nx * p0[0] + ny * p0[1] + nz * p0[2]), len * 0.5);
+        for (int k = 0; k < 3; ++k) { quadrics[weld[t[k]]] += q; }
+    }
+
+    // Lock positions on edges that don't have exactly two triangles
+    std::vector<char> locked(nv, 0);
+    {
+        std::unordered_map<uint64_t, int> edges;
+        edges.reserve(tris.size() * 2);
+        for (const Vec3i &t : tris) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t a = weld[t[k]], b = weld[t[(k + 1) % 3]];
+                ++edges[(uint64_t) std::min(a, b) << 32 | std::max(a, b)];
+            }
+        }
+        for (const auto &e : edges) {
+            if (e.second != 2) {
+                locked[e.first >> 32] = 1;
+                locked[e.first & 0xffffffffu] = 1;
+            }
+        }
+    }
+
+    // Where each position has collapsed to, itself if it hasn't
+    std::vector<int> collapsed(nv);
+    for (int v = 0; v < nv; ++v) { collapsed[v] = v; }
+    auto find = [&](int v) {
+        while (collapsed[v] != v) { v = collapsed[v] = collapsed[collapsed[v]]; }
+        return v;
+    };
+
+    std::vector<int> offsets(nv + 1), adjacency;
+    std::vector<char> touched(nv);
+    std::vector<Collapse> candidates;
+    double maxCost = 0;
+
+    while (tris.size() > targetFaces) {
+
+        // Position to triangle adjacency
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (const Vec3i &t : tris) { for (int k = 0; k < 3; ++k) { ++offsets[weld[t[k]] + 1]; } }
+        for (int v = 0; v < nv; ++v) { offsets[v + 1] += offsets[v]; }
+        adjacency.resize(tris.size() * 3);
+        std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < tris.size(); ++t) {
+            for (int k = 0; k < 3; ++k) { adjacency[fill[weld[tris[t][k]]]++] = t; }
+        }
+
+        // Cheapest direction of every edge
+        candidates.clear();
+        for (const Vec3i &t : tris) {
+            for (int k = 0; k < 3; ++k) {
+                int a = weld[t[k]], b = weld[t[(k + 1) % 3]];
+                if (a > b && !locked[a] && !locked[b]) { continue; } // interior edges are seen twice
+                Quadric q = quadrics[a];
+                q += quadrics[b];
+                double toB = locked[a] ? HUGE_VAL : q.error(pos(b));
+                double toA = locked[b] ? HUGE_VAL : q.error(pos(a));
+                if (toB == HUGE_VAL && toA == HUGE_VAL) { continue; }
+                candidates.push_back(toB <= toA ? Collapse{toB, a, b} : Collapse{toA, b, a});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        // Apply the cheapest collapses that don't overlap or flip triangles
+        std::fill(touched.begin(), touched.end(), 0);
+        const size_t wanted = tris.size() - targetFaces;
+        size_t removed = 0;
+        for (const Collapse &c : candidates) {
+            if (removed >= wanted) { break; }
+            if (touched[c.from] || touched[c.to]) { continue; }
+
+            bool flips = false;
+            int lost = 0;
+            for (int a = offsets[c.from]; a < offsets[c.from + 1] && !flips; ++a) {
+                const Vec3i &t = tris[adjacency[a]];
+                int w0 = weld[t[0]], w1 = weld[t[1]], w2 = weld[t[2]];
+                if (w0 == c.to || w1 == c.to || w2 == c.to) {
+                    ++lost;
+                    continue;
+                }
+                Vec3f before = triangleNormal(pos(w0), pos(w1), pos(w2));
+                Vec3f after = triangleNormal(pos(w0 == c.from ? c.to : w0), pos(w1 == c.from ? c.to : w1),
+                                             pos(w2 == c.from ? c.to : w2));
+                flips = before.dot(after) <= 0;
+            }
+            if (flips) { continue; }
+
+            collapsed[c.from] = c.to;
+            quadrics[c.to] += quadrics[c.from];
+            maxCost = std::max(maxCost, c.cost);
+            removed += lost;
+            for (int a = offsets[c.from]; a < offsets[c.from + 1]; ++a) {
+                const Vec3i &t = tris[adjacency[a]];
+                for (int k = 0; k < 3; ++k) { touched[weld[t[k]]] = 1; }
+            }
+        }
+        if (removed == 0) { break; }
+
+        // Move collapsed corners and drop triangles that became degenerate
+        size_t kept = 0;
+        for (size_t t = 0; t < tris.size(); ++t) {
+            Vec3i tri = tris[t];
+            for (int k = 0; k < 3; ++k) {
+                int to = find(weld[tri[k]]);
+                if (to != weld[tri[k]]) { tri[k] = to; }
+            }
+            if (weld[tri[0]] == weld[tri[1]] || weld[tri[1]] == weld[tri[2]] || weld[tri[2]] == weld[tri[0]]) {
+                continue;
+            }
+            tris[kept++] = tri;
+        }
+        tris.resize(kept);
+    }
+
+    for (Vec3i &t : tris) { for (int k = 0; k < 3; ++k) { t[k] = global[t[k]]; } }
+    *error = (float) std::sqrt(maxCost);
+    return tris;
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <string>
+
+//
+//	Spans of time on a timeline, for a look at startup and at frames that
+//	hitch, written as Chrome trace events that chrome://tracing and Perfetto
+//	open. TRACE_SCOPE(name) times the block it is in on the thread it runs
+//	on. Each thread appends its spans to a buffer of its own, a list of fixed
+//	size chunks, and publishes how many it wrote with a release store, so
+//	recording takes no lock and only the first span on a thread allocates,
+//	along with one span in every CHUNK_SIZE after it. trace::start names the
+//	file, which is written when the program exits. Names have to outlive
+//	that, string literals do. Built without ENABLE_TRACE (the TRACE option in
+//	CMake) the macros are empty and nothing is compiled in.
+//
+
+#ifdef ENABLE_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace trace {
+
+namespace trace_detail {
+
+struct Span {
+    const char *name;
+    uint64_t start, duration; // nanoseconds on the steady clock
+};
+
+const size_t CHUNK_SIZE = 4096;
+
+struct Chunk {
+    Span spans[CHUNK_SIZE];
+    std::atomic<size_t> count{0};
+    std::atomic<Chunk *> next{nullptr};
+};
+
+// Written by its thread only, read by the dump
+struct ThreadBuffer {
+    Chunk first;
+    Chunk *last = &first;
+    uint32_t id = 0;
+    std::atomic<const char *> name{nullptr};
+    ThreadBuffer *next = nullptr; // in the list of all buffers
+};
+
+struct State {
+    std::atomic<bool> recording{false};
+    std::atomic<ThreadBuffer *> buffers{nullptr};
+    std::atomic<uint32_t> threads{0};
+    uint64_t origin = 0;
+    std::string file;
+};
+
+inline State &state() {
+    static State s;
+    return s;
+}
+
+inline uint64_t now() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// This thread's buffer, made and pushed onto the list the first time. It is
+// never freed, the dump reads it after the thread is gone.
+inline ThreadBuffer &buffer() {
+    static thread_local ThreadBuffer *mine = nullptr;
+    if (mine == nullptr) {
+        State &s = state();
+        mine = new ThreadBuffer();
+        mine->id = ++s.threads;
+        mine->next = s.buffers.load(std::memory_order_relaxed);
+        while (!s.buffers.compare_exchange_weak(mine->next, mine, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+    return *mine;
+}
+
+inline void record(const char *name, uint64_t start, uint64_t end) {
+    ThreadBuffer &b = buffer();
+    Chunk *chunk = b.last;
+    size_t n = chunk->count.load(std::memory_order_relaxed);
+    if (n == CHUNK_SIZE) {
+        Chunk *grown = new Chunk();
+        chunk->next.store(grown, std::memory_order_release);
+        chunk = b.last = grown;
+        n = 0;
+    }
+    chunk->spans[n] = {name, start, end - start};
+    chunk->count.store(n + 1, std::memory_order_release);
+}
+
+// Names are ours or string literals, escaped anyway
+inline void writeString(std::FILE *out, const char *s) {
+    std::fputc('"', out);
+    for (; *s != 0; ++s) {
+        if (*s == '"' || *s == '\\') { std::fputc('\\', out); }
+        if ((unsigned char) *s >= 0x20) { std::fputc(*s, out); }
+    }
+    std::fputc('"', out);
+}
+
+inline void dump() {
+    State &s = state();
+    s.recording.store(false, std::memory_order_relaxed);
+    std::FILE *out = std::fopen(s.file.c_str(), "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "**Warning: Could not write trace %s\n", s.file.c_str());
+        return;
+    }
+    size_t spans = 0;
+    std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    const char *separator = "\n";
+    for (ThreadBuffer *b = s.buffers.load(std::memory_order_acquire); b != nullptr; b = b->next) {
+        const char *name = b->name.load(std::memory_order_acquire);
+        if (name != nullptr) {
+            std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", separator, b->id);
+            writeString(out, name);
+            std::fprintf(out, "}}");
+            separator = ",\n";
+        }
+        for (Chunk *c = &b->first; c != nullptr; c = c->next.load(std::memory_order_acquire)) {
+            const size_t n = c->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < n; ++i) {
+                const Span &span = c->spans[i];
+                std::fprintf(out, "%s{\"name\":", separator);
+                writeString(out, span.name);
+                // Microseconds from start, the unit the format wants
+                std::fprintf(out, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                             (double) (int64_t) (span.start - s.origin) * 1e-3, span.duration * 1e-3, b->id);
+                separator = ",\n";
+            }
+            spans += n;
+        }
+    }
+    std::fprintf(out, "\n]}\n");
+    const bool ok = std::ferror(out) == 0;
+    if (std::fclose(out) != 0 || !ok) { std::fprintf(stderr, "**Warning: Could not write trace %s\n", s.file.c_str()); }
+    else { std::printf("Wrote %zu spans to %s\n", spans, s.file.c_str()); }
+}
+
+} // end namespace trace_detail
+
+const bool COMPILED_IN = true;
+
+// Starts recording, to be written to file at exit. Spans before this aren't kept.
+inline bool start(const std::string &file) {
+    trace_detail::State &s = trace_detail::state();
+    if (s.recording.load(std::memory_order_relaxed)) { return true; }
+    s.file = file;
+    s.origin = trace_detail::now();
+    s.recording.store(true, std::memory_order_relaxed);
+    std::atexit(trace_detail::dump);
+    return true;
+}
+
+inline bool recording() { return trace_detail::state().recording.load(std::memory_order_relaxed); }
+
+// Names the calling thread's row in the timeline
+inline void threadName(const char *name) { trace_detail::buffer().name.store(name, std::memory_order_release); }
+
+// A span from start to end, seconds on the steady clock, for code that
+// already reads it
+inline void span(const char *name, double start, double end) {
+    if (recording()) { trace_detail::record(name, (uint64_t) (start * 1e9), (uint64_t) (end * 1e9)); }
+}
+
+// Times its own lifetime, if recording when it began
+class Scope {
+public:
+    explicit Scope(const char *name) : name(name), start(recording() ? trace_detail::now() : 0) {}
+
+    ~Scope() {
+        if (start != 0) { trace_detail::record(name, start, trace_detail::now()); }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+} // end namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SPAN(name, start, end) trace::span(name, start, end)
+#define TRACE_THREAD_NAME(name) trace::threadName(name)
+
+#else
+
+namespace trace {
+
+const bool COMPILED_IN = false;
+
+inline bool start(const std::string &) { return false; }
+
+} // end namespace trace
+
+#define TRACE_SCOPE(name) ((void) 0)
+#define TRACE_SPAN(name, start, end) ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) 0)
+
+#endif
+
+#endif
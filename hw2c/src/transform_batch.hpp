@@ -0,0 +1,341 @@
+#ifndef TRANSFORM_BATCH_HPP
+#define TRANSFORM_BATCH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "mat4.hpp"
+#include "parallel.hpp"
+
+#if defined(MAT4_SSE) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_BATCH_AVX // AVX kernels are compiled for AVX on their own and only run if the CPU has it
+#include <immintrin.h>
+#endif
+
+//
+//	Transforms of whole arrays of points (w = 1) or directions (w = 0) by a
+//	Mat4, for baking transforms into meshes, and bounding boxes of point arrays.
+//	Arrays are either AoS, x y z x y z ..., or SoA, separate x, y and z arrays.
+//	The kernels use AVX if the CPU has it and SSE otherwise, picked at run time.
+//	All of them compute a coordinate as m0 * x + m1 * y + m2 * z + m3, in that
+//	order, so they give the same bits. Input and output may be the same array.
+//
+
+enum SimdLevel {
+    SIMD_SCALAR, SIMD_SSE, SIMD_AVX
+};
+
+inline SimdLevel detectSimdLevel() {
+#if defined(TRANSFORM_BATCH_AVX)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx") ? SIMD_AVX : SIMD_SSE;
+#elif defined(MAT4_SSE)
+    return SIMD_SSE;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+// Best level this CPU runs, the default for all kernels
+inline SimdLevel simdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+inline const char *simdLevelName(SimdLevel level) {
+    return level == SIMD_AVX ? "AVX" : level == SIMD_SSE ? "SSE" : "scalar";
+}
+
+namespace transform_batch_detail {
+
+// Top three rows of m, with the last column scaled by w
+struct Rows {
+    float r[3][4];
+
+    Rows(const Mat4 &m, float w) {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) { r[i][j] = m.get(i, j) * (j == 3 ? w : 1); }
+        }
+    }
+};
+
+static void aosScalar(const Rows &m, const float *in, float *out, size_t begin, size_t end) {
+    for (size_t p = begin; p < end; ++p) {
+        const float x = in[3 * p], y = in[3 * p + 1], z = in[3 * p + 2];
+        for (int i = 0; i < 3; ++i) { out[3 * p + i] = m.r[i][0] * x + m.r[i][1] * y + m.r[i][2] * z + m.r[i][3]; }
+    }
+}
+
+static void soaScalar(const Rows &m, const float *const in[3], float *const out[3], size_t begin, size_t end) {
+    for (size_t p = begin; p < end; ++p) {
+        const float x = in[0][p], y = in[1][p], z = in[2][p];
+        for (int i = 0; i < 3; ++i) { out[i][p] = m.r[i][0] * x + m.r[i][1] * y + m.r[i][2] * z + m.r[i][3]; }
+    }
+}
+
+static void boundsScalar(const float *xyz, size_t begin, size_t end, float lo[3], float hi[3]) {
+    for (size_t p = begin; p < end; ++p) {
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], xyz[3 * p + a]);
+            hi[a] = std::max(hi[a], xyz[3 * p + a]);
+        }
+    }
+}
+
+#ifdef MAT4_SSE
+
+// Four AoS points in three registers, (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3), to x, y and z
+// registers and back. Written as macros so the AVX kernels can use them with _mm256_shuffle_ps,
+// which shuffles both 128 bit halves the same way.
+#define TRANSFORM_BATCH_TO_SOA(shuffle, a, b, c, x, y, z) \
+    x = shuffle(a, shuffle(b, c, _MM_SHUFFLE(0, 1, 0, 2)), _MM_SHUFFLE(2, 0, 3, 0)); \
+    y = shuffle(shuffle(a, b, _MM_SHUFFLE(0, 0, 0, 1)), shuffle(b, c, _MM_SHUFFLE(0, 2, 0, 3)), _MM_SHUFFLE(2, 0, 2, 0)); \
+    z = shuffle(shuffle(a, b, _MM_SHUFFLE(0, 1, 0, 2)), shuffle(c, c, _MM_SHUFFLE(0, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+#define TRANSFORM_BATCH_TO_AOS(shuffle, x, y, z, a, b, c) \
+    a = shuffle(shuffle(x, y, _MM_SHUFFLE(0, 0, 0, 0)), shuffle(z, x, _MM_SHUFFLE(0, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)); \
+    b = shuffle(shuffle(y, z, _MM_SHUFFLE(0, 1, 0, 1)), shuffle(x, y, _MM_SHUFFLE(0, 2, 0, 2)), _MM_SHUFFLE(2, 0, 2, 0)); \
+    c = shuffle(shuffle(z, x, _MM_SHUFFLE(0, 3, 0, 2)), shuffle(y, z, _MM_SHUFFLE(0, 3, 0, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+// m0 * x + m1 * y + m2 * z + m3 for row i, with m broadcast in m[4 * i + j]
+#define TRANSFORM_BATCH_ROW(add, mul, m, i, x, y, z) \
+    add(add(add(mul(m[4 * (i)], x), mul(m[4 * (i) + 1], y)), mul(m[4 * (i) + 2], z)), m[4 * (i) + 3])
+
+static void aosSse(const Rows &rows, const float *in, float *out, size_t begin, size_t end) {
+    __m128 m[12];
+    for (int k = 0; k < 12; ++k) { m[k] = _mm_set1_ps(rows.r[k / 4][k % 4]); }
+    size_t p = begin;
+    for (; p + 4 <= end; p += 4) {
+        const float *src = in + 3 * p;
+        __m128 a = _mm_loadu_ps(src), b = _mm_loadu_ps(src + 4), c = _mm_loadu_ps(src + 8), x, y, z;
+        TRANSFORM_BATCH_TO_SOA(_mm_shuffle_ps, a, b, c, x, y, z)
+        const __m128 tx = TRANSFORM_BATCH_ROW(_mm_add_ps, _mm_mul_ps, m, 0, x, y, z);
+        const __m128 ty = TRANSFORM_BATCH_ROW(_mm_add_ps, _mm_mul_ps, m, 1, x, y, z);
+        const __m128 tz = TRANSFORM_BATCH_ROW(_mm_add_ps, _mm_mul_ps, m, 2, x, y, z);
+        TRANSFORM_BATCH_TO_AOS(_mm_shuffle_ps, tx, ty, tz, a, b, c)
+        float *dst = out + 3 * p;
+        _mm_storeu_ps(dst, a);
+        _mm_storeu_ps(dst + 4, b);
+        _mm_storeu_ps(dst + 8, c);
+    }
+    aosScalar(rows, in, out, p, end);
+}
+
+static void soaSse(const Rows &rows, const float *const in[3], float *const out[3], size_t begin, size_t end) {
+    __m128 m[12];
+    for (int k = 0; k < 12; ++k) { m[k] = _mm_set1_ps(rows.r[k / 4][k % 4]); }
+    size_t p = begin;
+    for (; p + 4 <= end; p += 4) {
+        const __m128 x = _mm_loadu_ps(in[0] + p), y = _mm_loadu_ps(in[1] + p), z = _mm_loadu_ps(in[2] + p);
+        for (int i = 0; i < 3; ++i) { _mm_storeu_ps(out[i] + p, TRANSFORM_BATCH_ROW(_mm_add_ps, _mm_mul_ps, m, i, x, y, z)); }
+    }
+    soaScalar(rows, in, out, p, end);
+}
+
+// The lanes of the three registers always hold x y z x, y z x y and z x y z
+static void boundsSse(const float *xyz, size_t begin, size_t end, float lo[3], float hi[3]) {
+    size_t p = begin;
+    if (end - begin >= 4) {
+        __m128 low[3], high[3];
+        for (int r = 0; r < 3; ++r) { low[r] = high[r] = _mm_loadu_ps(xyz + 3 * p + 4 * r); }
+        for (p += 4; p + 4 <= end; p += 4) {
+            for (int r = 0; r < 3; ++r) {
+                const __m128 v = _mm_loadu_ps(xyz + 3 * p + 4 * r);
+                low[r] = _mm_min_ps(low[r], v);
+                high[r] = _mm_max_ps(high[r], v);
+            }
+        }
+        float l[12], h[12];
+        for (int r = 0; r < 3; ++r) {
+            _mm_storeu_ps(l + 4 * r, low[r]);
+            _mm_storeu_ps(h + 4 * r, high[r]);
+        }
+        for (int k = 0; k < 12; ++k) {
+            lo[k % 3] = std::min(lo[k % 3], l[k]);
+            hi[k % 3] = std::max(hi[k % 3], h[k]);
+        }
+    }
+    boundsScalar(xyz, p, end, lo, hi);
+}
+
+#endif
+
+#ifdef TRANSFORM_BATCH_AVX
+
+// Loads 128 bit halves from lo and hi
+__attribute__((target("avx"))) static inline __m256 loadHalves(const float *lo, const float *hi) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+}
+
+__attribute__((target("avx"))) static inline void storeHalves(float *lo, float *hi, __m256 v) {
+    _mm_storeu_ps(lo, _mm256_castps256_ps128(v));
+    _mm_storeu_ps(hi, _mm256_extractf128_ps(v, 1));
+}
+
+// Eight points at a time, points 0-3 in the low halves and 4-7 in the high ones
+__attribute__((target("avx"))) static void aosAvx(const Rows &rows, const float *in, float *out, size_t begin, size_t end) {
+    __m256 m[12];
+    for (int k = 0; k < 12; ++k) { m[k] = _mm256_set1_ps(rows.r[k / 4][k % 4]); }
+    size_t p = begin;
+    for (; p + 8 <= end; p += 8) {
+        const float *src = in + 3 * p;
+        __m256 a = loadHalves(src, src + 12), b = loadHalves(src + 4, src + 16), c = loadHalves(src + 8, src + 20), x, y, z;
+        TRANSFORM_BATCH_TO_SOA(_mm256_shuffle_ps, a, b, c, x, y, z)
+        const __m256 tx = TRANSFORM_BATCH_ROW(_mm256_add_ps, _mm256_mul_ps, m, 0, x, y, z);
+        const __m256 ty = TRANSFORM_BATCH_ROW(_mm256_add_ps, _mm256_mul_ps, m, 1, x, y, z);
+        const __m256 tz = TRANSFORM_BATCH_ROW(_mm256_add_ps, _mm256_mul_ps, m, 2, x, y, z);
+        TRANSFORM_BATCH_TO_AOS(_mm256_shuffle_ps, tx, ty, tz, a, b, c)
+        float *dst = out + 3 * p;
+        storeHalves(dst, dst + 12, a);
+        storeHalves(dst + 4, dst + 16, b);
+        storeHalves(dst + 8, dst + 20, c);
+    }
+    aosScalar(rows, in, out, p, end);
+}
+
+__attribute__((target("avx"))) static void soaAvx(const Rows &rows, const float *const in[3], float *const out[3],
+                                                  size_t begin, size_t end) {
+    __m256 m[12];
+    for (int k = 0; k < 12; ++k) { m[k] = _mm256_set1_ps(rows.r[k / 4][k % 4]); }
+    size_t p = begin;
+    for (; p + 8 <= end; p += 8) {
+        const __m256 x = _mm256_loadu_ps(in[0] + p), y = _mm256_loadu_ps(in[1] + p), z = _mm256_loadu_ps(in[2] + p);
+        for (int i = 0; i < 3; ++i) {
+            _mm256_storeu_ps(out[i] + p, TRANSFORM_BATCH_ROW(_mm256_add_ps, _mm256_mul_ps, m, i, x, y, z));
+        }
+    }
+    soaScalar(rows, in, out, p, end);
+}
+
+// 24 floats per step, so lane k of register r always holds coordinate (8 * r + k) % 3
+__attribute__((target("avx"))) static void boundsAvx(const float *xyz, size_t begin, size_t end, float lo[3], float hi[3]) {
+    size_t p = begin;
+    if (end - begin >= 8) {
+        __m256 low[3], high[3];
+        for (int r = 0; r < 3; ++r) { low[r] = high[r] = _mm256_loadu_ps(xyz + 3 * p + 8 * r); }
+        for (p += 8; p + 8 <= end; p += 8) {
+            for (int r = 0; r < 3; ++r) {
+                const __m256 v = _mm256_loadu_ps(xyz + 3 * p + 8 * r);
+                low[r] = _mm256_min_ps(low[r], v);
+                high[r] = _mm256_max_ps(high[r], v);
+            }
+        }
+        float l[24], h[24];
+        for (int r = 0; r < 3; ++r) {
+            _mm256_storeu_ps(l + 8 * r, low[r]);
+            _mm256_storeu_ps(h + 8 * r, high[r]);
+        }
+        for (int k = 0; k < 24; ++k) {
+            lo[k % 3] = std::min(lo[k % 3], l[k]);
+            hi[k % 3] = std::max(hi[k % 3], h[k]);
+        }
+    }
+    boundsScalar(xyz, p, end, lo, hi);
+}
+
+#endif
+
+static void transformAos(const Mat4 &matrix, float w, const float *in, float *out, size_t begin, size_t end, SimdLevel level) {
+    const Rows rows(matrix, w);
+#ifdef TRANSFORM_BATCH_AVX
+    if (level == SIMD_AVX) { return aosAvx(rows, in, out, begin, end); }
+#endif
+#ifdef MAT4_SSE
+    if (level != SIMD_SCALAR) { return aosSse(rows, in, out, begin, end); }
+#endif
+    aosScalar(rows, in, out, begin, end);
+}
+
+static void transformSoa(const Mat4 &matrix, float w, const float *const in[3], float *const out[3],
+                         size_t begin, size_t end, SimdLevel level) {
+    const Rows rows(matrix, w);
+#ifdef TRANSFORM_BATCH_AVX
+    if (level == SIMD_AVX) { return soaAvx(rows, in, out, begin, end); }
+#endif
+#ifdef MAT4_SSE
+    if (level != SIMD_SCALAR) { return soaSse(rows, in, out, begin, end); }
+#endif
+    soaScalar(rows, in, out, begin, end);
+}
+
+// Points per parallel block, 768 KB of AoS input
+static const size_t blockSize = 1 << 16;
+
+} // end namespace transform_batch_detail
+
+// n AoS points, 3 floats each
+inline void transformPoints(const Mat4 &m, const float *in, float *out, size_t n, SimdLevel level = simdLevel()) {
+    transform_batch_detail::transformAos(m, 1, in, out, 0, n, level);
+}
+
+inline void transformVectors(const Mat4 &m, const float *in, float *out, size_t n, SimdLevel level = simdLevel()) {
+    transform_batch_detail::transformAos(m, 0, in, out, 0, n, level);
+}
+
+// n SoA points, in and out are the x, y and z arrays
+inline void transformPoints(const Mat4 &m, const float *const in[3], float *const out[3], size_t n,
+                            SimdLevel level = simdLevel()) {
+    transform_batch_detail::transformSoa(m, 1, in, out, 0, n, level);
+}
+
+inline void transformVectors(const Mat4 &m, const float *const in[3], float *const out[3], size_t n,
+                             SimdLevel level = simdLevel()) {
+    transform_batch_detail::transformSoa(m, 0, in, out, 0, n, level);
+}
+
+// Same as the above on all cores, for large n
+inline void parallelTransformPoints(const Mat4 &m, const float *in, float *out, size_t n, SimdLevel level = simdLevel()) {
+    ThreadPool::global().parallelForRange(n, transform_batch_detail::blockSize, [&](size_t begin, size_t end) {
+        transform_batch_detail::transformAos(m, 1, in, out, begin, end, level);
+    });
+}
+
+inline void parallelTransformVectors(const Mat4 &m, const float *in, float *out, size_t n, SimdLevel level = simdLevel()) {
+    ThreadPool::global().parallelForRange(n, transform_batch_detail::blockSize, [&](size_t begin, size_t end) {
+        transform_batch_detail::transformAos(m, 0, in, out, begin, end, level);
+    });
+}
+
+inline void parallelTransformPoints(const Mat4 &m, const float *const in[3], float *const out[3], size_t n,
+                                    SimdLevel level = simdLevel()) {
+    ThreadPool::global().parallelForRange(n, transform_batch_detail::blockSize, [&](size_t begin, size_t end) {
+        transform_batch_detail::transformSoa(m, 1, in, out, begin, end, level);
+    });
+}
+
+inline void parallelTransformVectors(const Mat4 &m, const float *const in[3], float *const out[3], size_t n,
+                                     SimdLevel level = simdLevel()) {
+    ThreadPool::global().parallelForRange(n, transform_batch_detail::blockSize, [&](size_t begin, size_t end) {
+        transform_batch_detail::transformSoa(m, 0, in, out, begin, end, level);
+    });
+}
+
+// Bounding box of n AoS points on all cores, lo = HUGE_VALF and hi = -HUGE_VALF if n is 0
+inline void boundingBox(const float *xyz, size_t n, float lo[3], float hi[3], SimdLevel level = simdLevel()) {
+    using namespace transform_batch_detail;
+    const size_t numBlocks = (n + blockSize - 1) / blockSize;
+    std::vector<float> blockBounds(numBlocks * 6);
+    ThreadPool::global().parallelForRange(n, blockSize, [&](size_t begin, size_t end) {
+        float *l = &blockBounds[begin / blockSize * 6], *h = l + 3;
+        std::fill(l, l + 3, HUGE_VALF);
+        std::fill(h, h + 3, -HUGE_VALF);
+#ifdef TRANSFORM_BATCH_AVX
+        if (level == SIMD_AVX) { return boundsAvx(xyz, begin, end, l, h); }
+#endif
+#ifdef MAT4_SSE
+        if (level != SIMD_SCALAR) { return boundsSse(xyz, begin, end, l, h); }
+#endif
+        boundsScalar(xyz, begin, end, l, h);
+    });
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = HUGE_VALF;
+        hi[a] = -HUGE_VALF;
+        for (size_t b = 0; b < numBlocks; ++b) {
+            lo[a] = std::min(lo[a], blockBounds[b * 6 + a]);
+            hi[a] = std::max(hi[a], blockBounds[b * 6 + 3 + a]);
+        }
+    }
+}
+
+#endif
@@ -25,7 +25,20 @@
 #include <vector>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRIMESH_SSE2 1
+#endif
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
 
 //
 //	Vector Class
@@ -80,6 +93,20 @@ typedef Vec<3,float> Vec3f;
 typedef Vec<3,int> Vec3i;
 
 
+//
+//	Mesh View
+//	Non-owning pointers to mesh arrays, either those of a
+//	TriMesh or ones that live in a memory mapped file.
+//
+struct MeshView {
+	const Vec3f *vertices = nullptr;
+	const Vec3f *normals = nullptr;
+	const Vec3f *colors = nullptr;
+	const Vec3i *faces = nullptr;
+	size_t num_vertices = 0, num_normals = 0, num_colors = 0, num_faces = 0;
+};
+
+
 //
 //	Triangle Mesh Class
 //
@@ -90,19 +117,39 @@ public:
 	std::vector<Vec3f> colors;
 	std::vector<Vec3i> faces;
 
+	// Number of vertices load_obj would have made without
+	// deduplication, i.e. one per face corner.
+	size_t unindexed_vertices = 0;
+
 	// Compute normals if not loaded from obj
-	// or if recompute is set to true.
-	void need_normals( bool recompute=false );
+	// or if recompute is set to true, on up to
+	// num_threads threads (0 to use all cores).
+	// One runs need_normals_reference.
+	void need_normals( bool recompute=false, int num_threads=1 );
+
+	// Original serial normals, kept as a reference
+	// to verify and time need_normals against.
+	void need_normals_reference( bool recompute=false );
 
 	// Sets a default vertex colors if
 	// they haven't been set.
 	void need_colors( Vec3f default_color = Vec3f(0.4,0.4,0.4) );
 
-	// Loads an OBJ file
-	bool load_obj( std::string file );
+	// Loads an OBJ file, parsing chunks of it on up to
+	// num_threads threads (0 to use all cores). With deduplicate
+	// set, face corners that share a position and normal
+	// share a vertex instead of each getting their own.
+	bool load_obj( std::string file, int num_threads=1, bool deduplicate=false );
+
+	// Original stream based loader, kept as a reference
+	// to verify and time load_obj against.
+	bool load_obj_reference( std::string file );
 
 	// Prints details about the mesh
 	void print_details();
+
+	// View of the mesh arrays, valid until the mesh changes
+	MeshView view() const;
 };
 
 
@@ -116,10 +163,223 @@ void TriMesh::print_details(){
 	std::cout << "Normals: " << normals.size() << std::endl;
 	std::cout << "Colors: " << colors.size() << std::endl;
 	std::cout << "Faces: " << faces.size() << std::endl;
+	if( unindexed_vertices > vertices.size() ){
+		const size_t saved = (unindexed_vertices - vertices.size()) * sizeof(Vec3f) * 3; // position, color, normal
+		std::cout << "Vertices before deduplication: " << unindexed_vertices << std::endl;
+		std::cout << "VBO bytes saved: " << saved << " (" << saved / (1024.0*1024.0) << " MB)" << std::endl;
+	}
+}
+
+
+MeshView TriMesh::view() const {
+	MeshView v;
+	v.vertices = vertices.data(); v.num_vertices = vertices.size();
+	v.normals = normals.data(); v.num_normals = normals.size();
+	v.colors = colors.data(); v.num_colors = colors.size();
+	v.faces = faces.data(); v.num_faces = faces.size();
+	return v;
 }
 
 
-void TriMesh::need_normals( bool recompute ){
+//
+//	Vertex normals
+//	need_normals gives the same bits as need_normals_reference, on the
+//	threads it is asked for. By default that is one, and one thread runs the
+//	serial loop, which nothing has yet been measured to beat on wall clock.
+//	On fewer than NORMALS_SORT_THREADS threads every thread owns a range of
+//	vertices and scans the faces in order for those with a corner in it. That
+//	reads every face once per thread, so on more threads the face corners are
+//	counting sorted into buckets of vertices instead, keeping face order, and
+//	every thread sums the corners of a bucket into its vertices. Either way
+//	threads never write to the same vertex and every vertex adds its faces in
+//	the order the serial loop does. Face normals and their normalization use
+//	SSE.
+//
+
+// Normal of a face and the weight of each corner, as need_normals_reference
+// computes them: x, y, z, 0, w0, w1, w2, 0. Faces it skips get all zeros,
+// which don't change a sum that starts at +0.
+static inline void face_normal_weights( const Vec3f &p0, const Vec3f &p1, const Vec3f &p2, float out[8] ){
+	std::fill( out, out + 8, 0.f );
+	Vec3f a = p0-p1,  b = p1-p2, c = p2-p0;
+	float l2a = a.len2(), l2b = b.len2(), l2c = c.len2();
+	if (!l2a || !l2b || !l2c){ return; }
+	Vec3f facenormal = a.cross( b );
+	for( int i = 0; i < 3; ++i ){ out[i] = facenormal[i]; }
+	out[4] = 1.0f / (l2a * l2c);
+	out[5] = 1.0f / (l2b * l2a);
+	out[6] = 1.0f / (l2c * l2b);
+}
+
+#ifdef TRIMESH_SSE2
+// x, y, z, 0 without reading past the vertex
+static inline __m128 load_vec3_sse( const Vec3f &v ){
+	return _mm_movelh_ps( _mm_loadl_pi( _mm_setzero_ps(), (const __m64 *) v.data ), _mm_load_ss( v.data + 2 ) );
+}
+
+// face_normal_weights with the vectors in SSE registers
+static inline void face_normal_weights_sse( const Vec3f &p0, const Vec3f &p1, const Vec3f &p2, float out[8] ){
+	const __m128 q0 = load_vec3_sse( p0 ), q1 = load_vec3_sse( p1 ), q2 = load_vec3_sse( p2 );
+	const __m128 a = _mm_sub_ps( q0, q1 ), b = _mm_sub_ps( q1, q2 ), c = _mm_sub_ps( q2, q0 );
+	// Squared lengths summed x, y then z like Vec::dot, in lanes 0 of l2a, l2b, l2c
+	auto len2 = []( __m128 x ){
+		x = _mm_mul_ps( x, x );
+		return _mm_add_ss( _mm_add_ss( x, _mm_shuffle_ps( x, x, 1 ) ), _mm_shuffle_ps( x, x, 2 ) );
+	};
+	const __m128 l2a = len2( a ), l2b = len2( b ), l2c = len2( c );
+	if( !_mm_cvtss_f32( l2a ) || !_mm_cvtss_f32( l2b ) || !_mm_cvtss_f32( l2c ) ){
+		std::fill( out, out + 8, 0.f );
+		return;
+	}
+	// a.yzx * b.zxy - a.zxy * b.yzx
+	const __m128 n = _mm_sub_ps(
+		_mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE(3,0,2,1) ), _mm_shuffle_ps( b, b, _MM_SHUFFLE(3,1,0,2) ) ),
+		_mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE(3,1,0,2) ), _mm_shuffle_ps( b, b, _MM_SHUFFLE(3,0,2,1) ) ) );
+	// w0, w1, w2 = 1 / (l2a*l2c, l2b*l2a, l2c*l2b)
+	const __m128 one = _mm_set_ss( 1.f );
+	const __m128 first = _mm_unpacklo_ps( _mm_unpacklo_ps( l2a, l2c ), _mm_unpacklo_ps( l2b, one ) );
+	const __m128 second = _mm_unpacklo_ps( _mm_unpacklo_ps( l2c, l2b ), _mm_unpacklo_ps( l2a, one ) );
+	const __m128 w = _mm_div_ps( _mm_set1_ps( 1.f ), _mm_mul_ps( first, second ) );
+	_mm_storeu_ps( out, n );
+	_mm_storeu_ps( out + 4, w );
+}
+#endif
+
+// Normalizes a summed vertex normal as Vec::normalize does, length in float
+// then double, and leaves a zero one alone
+static inline void normalize_sum( Vec3f &n ){
+#ifdef TRIMESH_SSE2
+	__m128 sum = _mm_setr_ps( n[0], n[1], n[2], 0.f );
+	__m128 sq = _mm_mul_ps( sum, sum );
+	__m128 l2 = _mm_add_ss( _mm_add_ss( sq, _mm_shuffle_ps( sq, sq, 1 ) ), _mm_shuffle_ps( sq, sq, 2 ) );
+	__m128d l = _mm_sqrt_sd( _mm_setzero_pd(), _mm_cvtss_sd( _mm_setzero_pd(), l2 ) );
+	if( _mm_cvtsd_f64( l ) <= 0.0 ){ return; }
+	l = _mm_unpacklo_pd( l, l );
+	__m128d xy = _mm_div_pd( _mm_cvtps_pd( sum ), l ), z = _mm_div_pd( _mm_cvtps_pd( _mm_movehl_ps( sum, sum ) ), l );
+	float out[4];
+	_mm_storeu_ps( out, _mm_movelh_ps( _mm_cvtpd_ps( xy ), _mm_cvtpd_ps( z ) ) );
+	n = Vec3f( out[0], out[1], out[2] );
+#else
+	n.normalize();
+#endif
+}
+
+static inline void weigh_face( const std::vector<Vec3f> &vertices, const Vec3i &face, float out[8] ){
+#ifdef TRIMESH_SSE2
+	face_normal_weights_sse( vertices[face[0]], vertices[face[1]], vertices[face[2]], out );
+#else
+	face_normal_weights( vertices[face[0]], vertices[face[1]], vertices[face[2]], out );
+#endif
+}
+
+// Threads at which need_normals counting sorts the corners instead of every
+// thread scanning all faces. Below it the scans cost less than the sort's
+// extra passes and its corner array, single core totals put it near 8.
+const int NORMALS_SORT_THREADS = 8;
+
+// Every thread owns a range of vertices and scans all faces for its corners
+static void normals_owner_scan( const std::vector<Vec3f> &vertices, const std::vector<Vec3i> &faces,
+	std::vector<Vec3f> &normals, ThreadPool &pool, int threads ){
+	const size_t nv = normals.size(), nf = faces.size();
+	std::vector<size_t> range( threads + 1 );
+	for( int t = 0; t <= threads; ++t ){ range[t] = nv * t / threads; }
+	pool.parallelFor( threads, [&]( int t ){
+		const size_t lo = range[t], hi = range[t+1];
+		auto owned = [&]( int v ){ return (size_t) v - lo < hi - lo; };
+		for( size_t v = lo; v < hi; ++v ){ normals[v] = Vec3f( 0.f, 0.f, 0.f ); }
+		float w[8];
+		for( size_t f = 0; f < nf; ++f ){
+			const Vec3i &face = faces[f];
+			if( !owned( face[0] ) && !owned( face[1] ) && !owned( face[2] ) ){ continue; }
+			weigh_face( vertices, face, w );
+			for( int k = 0; k < 3; ++k ){
+				if( !owned( face[k] ) ){ continue; }
+				Vec3f &n = normals[face[k]];
+				for( int i = 0; i < 3; ++i ){ n[i] += w[i] * w[4+k]; }
+			}
+		}
+		for( size_t v = lo; v < hi; ++v ){ normalize_sum( normals[v] ); }
+	}, threads );
+}
+
+// Corners counting sorted into buckets of vertices, every thread sums a bucket
+static void normals_counting_sort( const std::vector<Vec3f> &vertices, const std::vector<Vec3i> &faces,
+	std::vector<Vec3f> &normals, ThreadPool &pool, int threads ){
+	const size_t nv = normals.size(), nf = faces.size();
+
+	// Face corners counting sorted by bucket of vertices. Every thread counts
+	// the corners of its chunk of faces per bucket, and after a prefix sum over
+	// buckets, then chunks, weights its faces and places their corners, so
+	// every bucket lists its corners in face order.
+	const int bucket_bits = 12;
+	const size_t nb = (nv + (1 << bucket_bits) - 1) >> bucket_bits;
+	std::vector<size_t> slot( threads * nb ); // counts, then where the next corner goes
+	std::vector<size_t> chunk( threads + 1 );
+	for( int t = 0; t <= threads; ++t ){ chunk[t] = nf * t / threads; }
+	pool.parallelFor( threads, [&]( int t ){
+		size_t *count = &slot[t * nb];
+		for( size_t f = chunk[t]; f < chunk[t+1]; ++f ){
+			for( int k = 0; k < 3; ++k ){ ++count[faces[f][k] >> bucket_bits]; }
+		}
+	}, threads );
+	std::vector<size_t> bucket_start( nb + 1 );
+	size_t placed = 0;
+	for( size_t b = 0; b < nb; ++b ){
+		bucket_start[b] = placed;
+		for( int t = 0; t < threads; ++t ){
+			const size_t count = slot[t * nb + b];
+			slot[t * nb + b] = placed;
+			placed += count;
+		}
+	}
+	bucket_start[nb] = placed;
+
+	// What a corner adds to its vertex, left uninitialized as every one is written
+	struct Corner {
+		float normal[3];
+		int vertex;
+	};
+	std::unique_ptr<Corner[]> corners( new Corner[placed] );
+	pool.parallelFor( threads, [&]( int t ){
+		size_t *next = &slot[t * nb];
+		float w[8];
+		for( size_t f = chunk[t]; f < chunk[t+1]; ++f ){
+			const Vec3i &face = faces[f];
+			weigh_face( vertices, face, w );
+			for( int k = 0; k < 3; ++k ){
+				Corner &c = corners[next[face[k] >> bucket_bits]++];
+				for( int i = 0; i < 3; ++i ){ c.normal[i] = w[i] * w[4+k]; }
+				c.vertex = face[k];
+			}
+		}
+	}, threads );
+
+	// Every bucket adds its corners to its vertices in face order, like the serial loop
+	pool.parallelFor( (int) nb, [&]( int b ){
+		const size_t lo = (size_t) b << bucket_bits, hi = std::min( nv, lo + ((size_t) 1 << bucket_bits) );
+		for( size_t v = lo; v < hi; ++v ){ normals[v] = Vec3f( 0.f, 0.f, 0.f ); }
+		for( size_t i = bucket_start[b]; i < bucket_start[b+1]; ++i ){
+			Vec3f &n = normals[corners[i].vertex];
+			for( int d = 0; d < 3; ++d ){ n[d] += corners[i].normal[d]; }
+		}
+		for( size_t v = lo; v < hi; ++v ){ normalize_sum( normals[v] ); }
+	}, threads );
+}
+
+void TriMesh::need_normals( bool recompute, int num_threads ){
+	if( vertices.size() == normals.size() && !recompute ){ return; }
+	TRACE_SCOPE( "TriMesh::need_normals" );
+	ThreadPool &pool = ThreadPool::global();
+	const int threads = num_threads > 0 ? std::min( num_threads, pool.size() ) : pool.size();
+	if( threads <= 1 ){ need_normals_reference( true ); return; }
+	if( normals.size() != vertices.size() ){ normals.resize( vertices.size() ); }
+	std::cout << "Computing TriMesh normals" << std::endl;
+	if( threads < NORMALS_SORT_THREADS ){ normals_owner_scan( vertices, faces, normals, pool, threads ); }
+	else{ normals_counting_sort( vertices, faces, normals, pool, threads ); }
+} // end need normals
+
+
+void TriMesh::need_normals_reference( bool recompute ){
 	if( vertices.size() == normals.size() && !recompute ){ return; }
 	if( normals.size() != vertices.size() ){ normals.resize( vertices.size() ); }
 	std::cout << "Computing TriMesh normals" << std::endl;
@@ -140,7 +400,7 @@ void TriMesh::need_normals( bool recompute ){
 		normals[faces[f][2]] += facenormal * (1.0f / (l2c * l2b));
 	}
 	for (int i = 0; i < nv; i++){ normals[i].normalize(); }
-} // end need normals
+} // end need normals reference
 
 
 void TriMesh::need_colors( Vec3f default_color ){
@@ -148,13 +408,327 @@ void TriMesh::need_colors( Vec3f default_color ){
 	else{ colors.resize( vertices.size(), default_color ); }
 } // end need colors
 
+//
+//	OBJ parsing
+//	load_obj maps the file and tokenizes it in place, one chunk of lines per task.
+//	Faces may reference vertices that come later in the file, so face corners
+//	are kept as indices while parsing and resolved once every chunk is done.
+//
+
+// A face corner: zero based position and normal index (normal is -1 if absent)
+struct ObjCorner { int v, n; };
+
+// Records parsed from (a range of) an OBJ file
+struct ObjChunk {
+	std::vector<Vec3f> verts;
+	std::vector<Vec3f> colors;
+	std::vector<Vec3f> normals;
+	std::vector<ObjCorner> corners; // one per output vertex, in file order
+	std::vector<Vec3i> faces; // indices into corners
+	size_t corner_normals = 0; // number of corners that have a normal
+};
+
+static inline bool obj_is_space( char c ){ return c==' ' || c=='\t' || c=='\r' || c=='\v' || c=='\f'; }
+
+static inline void obj_skip_space( const char *&p, const char *end ){
+	while( p < end && obj_is_space(*p) ){ ++p; }
+}
+
+static inline void obj_skip_token( const char *&p, const char *end ){
+	while( p < end && !obj_is_space(*p) && *p != '\n' ){ ++p; }
+}
+
+// Open addressing hash table from face corners to the vertex made for them
+class ObjCornerTable {
+public:
+	explicit ObjCornerTable( size_t max_corners ){
+		size_t capacity = 16;
+		while( capacity < max_corners + max_corners/2 ){ capacity *= 2; }
+		keys.assign( capacity, empty_key );
+		values.resize( capacity );
+		mask = capacity-1;
+	}
+
+	// Returns true if c is new and maps it to *value,
+	// otherwise sets *value to the one c already has.
+	bool insert( const ObjCorner &c, int *value ){
+		const uint64_t key = (uint64_t(uint32_t(c.v)) << 32) | uint32_t(c.n+1);
+		size_t i = (key * 0x9E3779B97F4A7C15ull) >> 32 & mask;
+		while( keys[i] != empty_key ){
+			if( keys[i] == key ){ *value = values[i]; return false; }
+			i = (i+1) & mask; // linear probing
+		}
+		keys[i] = key; values[i] = *value;
+		return true;
+	}
+
+private:
+	static constexpr uint64_t empty_key = ~uint64_t(0);
+	std::vector<uint64_t> keys;
+	std::vector<int> values;
+	size_t mask;
+};
+
+// Parses the next float on the line and moves p past it, false if there is none
+static inline bool obj_parse_float( const char *&p, const char *end, float *out ){
+	obj_skip_space( p, end );
+	if( p < end && *p == '+' ){ ++p; }
+#if defined(__cpp_lib_to_chars)
+	std::from_chars_result r = std::from_chars( p, end, *out );
+	if( r.ec != std::errc() ){ return false; }
+	p = r.ptr;
+#else
+	// No floating point from_chars, copy the token so strtof can't run past the line
+	char tmp[64]; size_t n = 0;
+	while( p+n < end && n < sizeof(tmp)-1 && !obj_is_space(p[n]) && p[n] != '\n' ){ tmp[n] = p[n]; ++n; }
+	tmp[n] = '\0';
+	char *e; *out = std::strtof( tmp, &e );
+	if( e == tmp ){ return false; }
+	p += e - tmp;
+#endif
+	return true;
+}
+
+static inline bool obj_parse_int( const char *&p, const char *end, int *out ){
+	if( p < end && *p == '+' ){ ++p; }
+	std::from_chars_result r = std::from_chars( p, end, *out );
+	if( r.ec != std::errc() ){ return false; }
+	p = r.ptr;
+	return true;
+}
+
+// Parses a v, v/t, v/t/n or v//n face corner, false if it has no position index
+static inline bool obj_parse_corner( const char *&p, const char *end, ObjCorner *c ){
+	int v;
+	if( !obj_parse_int( p, end, &v ) ){ return false; }
+	c->v = v-1; c->n = -1;
+	if( p < end && *p == '/' ){
+		++p; // skip the texture coordinate
+		while( p < end && *p != '/' && !obj_is_space(*p) && *p != '\n' ){ ++p; }
+		if( p < end && *p == '/' ){
+			++p; int n;
+			if( obj_parse_int( p, end, &n ) ){ c->n = n-1; }
+		}
+	}
+	obj_skip_token( p, end );
+	return true;
+}
+
+// Parses the v, vn and f records in [p,end), which must start at a line
+static void parse_obj_chunk( const char *p, const char *end, ObjChunk *chunk ){
+
+	while( p < end ){
+
+		obj_skip_space( p, end );
+		const char *tok = p;
+		obj_skip_token( p, end );
+		const size_t len = p - tok;
+
+		// Vertex
+		if( len == 1 && tok[0] == 'v' ){
+
+			// First three location
+			float x = 0.f, y = 0.f, z = 0.f;
+			obj_parse_float( p, end, &x ) && obj_parse_float( p, end, &y ) && obj_parse_float( p, end, &z );
+			chunk->verts.push_back( Vec3f(x,y,z) );
+
+			// Next three colors
+			float cx, cy, cz;
+			if( obj_parse_float( p, end, &cx ) && obj_parse_float( p, end, &cy ) && obj_parse_float( p, end, &cz ) ){
+				chunk->colors.push_back( Vec3f(cx,cy,cz) );
+			} else {
+				chunk->colors.push_back( Vec3f(0.3f,0.3f,0.3f) );
+			}
+		}
+
+		// Normal
+		else if( len == 2 && tok[0] == 'v' && tok[1] == 'n' ){
+			float x = 0.f, y = 0.f, z = 0.f;
+			obj_parse_float( p, end, &x ) && obj_parse_float( p, end, &y ) && obj_parse_float( p, end, &z );
+			chunk->normals.push_back( Vec3f(x,y,z) );
+		}
+
+		// Face, a triangle or a quad (split into two triangles)
+		else if( len == 1 && tok[0] == 'f' ){
+			ObjCorner c[4]; int nc = 0;
+			while( nc < 4 ){
+				obj_skip_space( p, end );
+				if( p >= end || *p == '\n' || !obj_parse_corner( p, end, &c[nc] ) ){ break; }
+				++nc;
+			}
+			if( nc >= 3 ){
+				const int base = chunk->corners.size();
+				for( int i=0; i<nc; ++i ){
+					chunk->corners.push_back( c[i] );
+					if( c[i].n >= 0 ){ ++chunk->corner_normals; }
+				}
+				chunk->faces.push_back( Vec3i(base, base+1, base+2) );
+				if( nc == 4 ){ chunk->faces.push_back( Vec3i(base, base+2, base+3) ); }
+			}
+		}
+
+		// Next line
+		while( p < end && *p != '\n' ){ ++p; }
+		if( p < end ){ ++p; }
+
+	} // end loop lines
+}
+
+bool TriMesh::load_obj( std::string file, int num_threads, bool deduplicate ){
+
+	std::cout << "\nLoading " << file << std::endl;
+	TRACE_SCOPE( "TriMesh::load_obj" );
+
+	//	README:
+	//
+	//	The problem with standard obj files and opengl is that
+	//	there isn't a good way to make triangles with different indices
+	//	for vertices/normals. By default we'll do the inefficient (but robust)
+	//	way: redundant vertices/normals. With deduplicate, every distinct
+	//	(position, normal) index pair becomes one vertex that faces share.
+	//
+
+	MappedFile mapped;
+	if( !mapped.open( file ) ){ std::cerr << "\n**TriMesh::load_obj Error: Could not open file " << file << std::endl; return false; }
+	const char *begin = mapped.data();
+	const char *end = begin + mapped.size();
+
+	//
+	//	Split the file into newline aligned chunks and parse them in parallel.
+	//	One thread parses a single chunk, which is the serial loader.
+	//
+	ThreadPool &pool = ThreadPool::global();
+	const int threads = num_threads > 0 ? std::min( num_threads, pool.size() ) : pool.size();
+	const size_t min_chunk_size = 1 << 20;
+	const int nc = std::max<size_t>( 1, std::min<size_t>( threads > 1 ? threads*4 : 1, mapped.size() / min_chunk_size ) );
+	std::vector<const char*> bounds( nc+1, end );
+	bounds[0] = begin;
+	for( int i=1; i<nc; ++i ){
+		const char *p = std::max( begin + mapped.size() / nc * i, bounds[i-1] );
+		const char *nl = (const char*)std::memchr( p, '\n', end-p );
+		bounds[i] = nl ? nl+1 : end;
+	}
+	std::vector<ObjChunk> chunks( nc );
+	{
+		TRACE_SCOPE( "load_obj parse" );
+		pool.parallelFor( nc, [&]( int i ){
+			TRACE_SCOPE( "parse_obj_chunk" );
+			parse_obj_chunk( bounds[i], bounds[i+1], &chunks[i] );
+		}, threads );
+	}
+
+	TRACE_SCOPE( "load_obj resolve" );
+
+	//
+	//	Prefix sums give each chunk its range in the gathered records and the output
+	//
+	struct ChunkOffsets { size_t verts, normals, corners, corner_normals, faces; };
+	std::vector<ChunkOffsets> offsets( nc+1 );
+	offsets[0] = ChunkOffsets{ 0, 0, 0, 0, 0 };
+	for( int i=0; i<nc; ++i ){
+		offsets[i+1].verts = offsets[i].verts + chunks[i].verts.size();
+		offsets[i+1].normals = offsets[i].normals + chunks[i].normals.size();
+		offsets[i+1].corners = offsets[i].corners + chunks[i].corners.size();
+		offsets[i+1].corner_normals = offsets[i].corner_normals + chunks[i].corner_normals;
+		offsets[i+1].faces = offsets[i].faces + chunks[i].faces.size();
+	}
+	const ChunkOffsets &total = offsets[nc];
+
+	//
+	//	Gather the v/vn records and check the face indices
+	//
+	std::vector<Vec3f> temp_verts( total.verts );
+	std::vector<Vec3f> temp_colors( total.verts );
+	std::vector<Vec3f> temp_normals( total.normals );
+	std::vector<char> bad_index( nc, 0 );
+	pool.parallelFor( nc, [&]( int i ){
+		ObjChunk &chunk = chunks[i];
+		std::copy( chunk.verts.begin(), chunk.verts.end(), temp_verts.begin() + offsets[i].verts );
+		std::copy( chunk.colors.begin(), chunk.colors.end(), temp_colors.begin() + offsets[i].verts );
+		std::copy( chunk.normals.begin(), chunk.normals.end(), temp_normals.begin() + offsets[i].normals );
+		std::vector<Vec3f>().swap( chunk.verts );
+		std::vector<Vec3f>().swap( chunk.colors );
+		std::vector<Vec3f>().swap( chunk.normals );
+		for( const ObjCorner &c : chunk.corners ){
+			if( c.v < 0 || c.v >= (int)total.verts || c.n >= (int)total.normals ){ bad_index[i] = 1; }
+		}
+	}, threads );
+	if( std::count( bad_index.begin(), bad_index.end(), 1 ) ){
+		std::cerr << "\n**TriMesh::load_obj Error: Bad face index in " << file << std::endl;
+		return false;
+	}
+
+	const size_t vbase = vertices.size(), cbase = colors.size(), nbase = normals.size(), fbase = faces.size();
+	unindexed_vertices = std::max( unindexed_vertices, vbase ) + total.corners;
+	if( deduplicate ){
+
+		//
+		//	Resolve face corners into shared vertices, in file order
+		//
+		ObjCornerTable table( total.corners );
+		std::vector<int> corner_vertex( total.corners );
+		size_t k = 0;
+		for( const ObjChunk &chunk : chunks ){
+			for( const ObjCorner &c : chunk.corners ){
+				int v = vertices.size() - vbase;
+				if( table.insert( c, &v ) ){
+					vertices.push_back( temp_verts[c.v] );
+					colors.push_back( temp_colors[c.v] );
+					if( c.n >= 0 ){ normals.push_back( temp_normals[c.n] ); }
+				}
+				corner_vertex[k++] = vbase + v;
+			}
+		}
+		faces.resize( fbase + total.faces );
+		pool.parallelFor( nc, [&]( int i ){
+			const int *first = corner_vertex.data() + offsets[i].corners;
+			Vec3i *out = faces.data() + fbase + offsets[i].faces;
+			for( const Vec3i &f : chunks[i].faces ){ *out++ = Vec3i(first[f[0]], first[f[1]], first[f[2]]); }
+		}, threads );
+
+	} else {
+
+		//
+		//	Resolve face corners into vertices, each chunk fills its own range
+		//
+		vertices.resize( vbase + total.corners );
+		colors.resize( cbase + total.corners );
+		normals.resize( nbase + total.corner_normals );
+		faces.resize( fbase + total.faces );
+		pool.parallelFor( nc, [&]( int i ){
+			const ObjChunk &chunk = chunks[i];
+			size_t v = offsets[i].corners, n = nbase + offsets[i].corner_normals;
+			for( const ObjCorner &c : chunk.corners ){
+				vertices[vbase+v] = temp_verts[c.v];
+				colors[cbase+v] = temp_colors[c.v];
+				if( c.n >= 0 ){ normals[n++] = temp_normals[c.n]; }
+				++v;
+			}
+			const int first = vbase + offsets[i].corners;
+			Vec3i *out = faces.data() + fbase + offsets[i].faces;
+			for( const Vec3i &f : chunk.faces ){ *out++ = Vec3i(first+f[0], first+f[1], first+f[2]); }
+		}, threads );
+
+	} // end resolve corners
+
+	// Make sure we have normals
+	if( !normals.size() ){
+		std::cout << "**Warning: normals not loaded so we'll compute them instead." << std::endl;
+		need_normals( false );
+	}
+
+	return true;
+
+} // end load obj
+
+
 // Function to split a string into multiple strings, seperated by delimeter
 static void split_str( char delim, const std::string &str, std::vector<std::string> *result ){
 	std::stringstream ss(str); std::string s;
 	while( std::getline(ss, s, delim) ){ result->push_back(s); }
 }
 
-bool TriMesh::load_obj( std::string file ){
+bool TriMesh::load_obj_reference( std::string file ){
 
 	std::cout << "\nLoading " << file << std::endl;
 
@@ -259,10 +833,10 @@ bool TriMesh::load_obj( std::string file ){
 					split_str( '/', last_vert, &f_vals );
 					assert(f_vals.size()>0);
 
+					face2[2] = vertices.size();
 					int v_idx = std::stoi(f_vals[0])-1;
 					vertices.push_back( temp_verts[v_idx] );
 					colors.push_back( temp_colors[v_idx] );
-					face2[2] = vertices.size();
 
 					// Check for normal
 					if( f_vals.size()>2 ){
@@ -282,7 +856,7 @@ bool TriMesh::load_obj( std::string file ){
 	// Make sure we have normals
 	if( !normals.size() ){
 		std::cout << "**Warning: normals not loaded so we'll compute them instead." << std::endl;
-		need_normals();
+		need_normals_reference();
 	}
 
 	return true;
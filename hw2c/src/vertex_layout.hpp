@@ -0,0 +1,58 @@
+#ifndef VERTEX_LAYOUT_HPP
+#define VERTEX_LAYOUT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include "parallel.hpp"
+#include "quantize.hpp"
+#include "trimesh.hpp"
+
+//
+//	Interleaved vertex layouts: position, color and normal of a vertex next to
+//	each other in one buffer, so a vertex fetch touches one place instead of
+//	three streams. The fill functions write straight into the destination,
+//	usually a mapped GL buffer, so there is no intermediate copy of the mesh.
+//
+
+struct InterleavedVertex {
+    Vec3f position, color, normal;
+};
+
+// Same attributes as PackedVertices, 16 bytes per vertex
+struct InterleavedPackedVertex {
+    uint16_t position[4];
+    uint32_t color, normal;
+};
+
+static_assert(sizeof(InterleavedVertex) == 36, "InterleavedVertex must be tightly packed");
+static_assert(sizeof(InterleavedPackedVertex) == 16, "InterleavedPackedVertex must be tightly packed");
+
+// Interleaving needs one color and one normal per vertex
+static inline bool canInterleave(const MeshView &mesh) {
+    return mesh.num_colors == mesh.num_vertices && mesh.num_normals == mesh.num_vertices;
+}
+
+// Vertices per parallel block
+static const size_t interleaveBlockSize = 1 << 16;
+
+static void fillInterleaved(const MeshView &mesh, InterleavedVertex *out) {
+    ThreadPool::global().parallelForRange(mesh.num_vertices, interleaveBlockSize, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            out[v].position = mesh.vertices[v];
+            out[v].color = mesh.colors[v];
+            out[v].normal = mesh.normals[v];
+        }
+    });
+}
+
+static void fillInterleaved(const MeshView &mesh, const PositionQuantization &q, InterleavedPackedVertex *out) {
+    ThreadPool::global().parallelForRange(mesh.num_vertices, interleaveBlockSize, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            q.quantize(mesh.vertices[v], out[v].position);
+            out[v].color = packColor(mesh.colors[v]);
+            out[v].normal = packNormal(mesh.normals[v]);
+        }
+    });
+}
+
+#endif